@@ -1,17 +1,55 @@
+// For clock_gettime when building with a strict C standard.
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <assert.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "dandd.h"
 
 #define u8 uint8_t
+#define u16 uint16_t
+#define u32 uint32_t
 #define i32 int32_t
 #define u64 uint64_t
+#define i64 int64_t
 
 // Solutions are 8x8 matrices in row-major order. If the value is 1, there's a wall, if it's 0
 // there isn't. It's represented by a single 64-bit unsigned integer. Each binary digit is a 1
 // or a 0 which is the value for a slot in the matrix.
 
+#if !defined(DANDD_LIBRARY)
 // Print the solution in a matrix format, helpful for debugging.
 void print_grid(u64 result) {
     printf("grid: %" PRIu64 "\n", result);
@@ -22,15 +60,11 @@ void print_grid(u64 result) {
         }
     }
 }
+#endif
 
 // We refer the elements in the solution by either
 // * slot, the index 0-63 of the space.
-// * pos, the row (0-7) and column (0-7) of the space.
-
-typedef struct {
-    i32 row;
-    i32 col;
-} Pos;
+// * pos, the row (0-7) and column (0-7) of the space, a Pos.
 
 // Some helpers for converting positions and slots.
 // @note(steve): Slots and positions have slightly different interpretations when they're
@@ -83,34 +117,79 @@ u64 pos_is_set(u64 m, Pos pos) {
     return m & (u64)1 << (63 - (pos.row * 8 + pos.col));
 }
 
+// Bit twiddling helpers. These use the compiler intrinsics when they're available and fall back to
+// portable loops when they aren't.
+
 i32 count_set_bits(u64 n) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(n);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return (i32)__popcnt64(n);
+#else
     i32 count = 0;
     while (n) {
         n &= (n - 1);
         count++;
     }
     return count;
+#endif
 }
 
-// An easier to read and write representation of a puzzle.
-typedef struct {
-    u8 row_wall_counts[8];
-    u8 col_wall_counts[8];
-    Pos monsters[64];
-    u8 monsters_count;
-    Pos treasures[64];
-    u8 treasures_count;
-} PuzzleArgs;
+// Number of 0 bits below the lowest set bit. `n` must not be 0.
+i32 count_trailing_zeros(u64 n) {
+    assert(n != 0);
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(n);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanForward64(&index, n);
+    return (i32)index;
+#else
+    i32 count = 0;
+    while (!(n & 1)) {
+        n >>= 1;
+        count++;
+    }
+    return count;
+#endif
+}
 
-// The representation of a puzzle used internally. Monsters and treasures
-// are stored in a "solution" which makes comparing their positions to other solutions
-// via bitwise operations fast and easy.
-typedef struct {
-    u8 row_wall_counts[8];
-    u8 col_wall_counts[8];
-    u64 monsters;
-    u64 treasures;
-} Puzzle;
+// Number of 0 bits above the highest set bit. `n` must not be 0.
+i32 count_leading_zeros(u64 n) {
+    assert(n != 0);
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(n);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanReverse64(&index, n);
+    return 63 - (i32)index;
+#else
+    i32 count = 0;
+    while (!(n & ((u64)1 << 63))) {
+        n <<= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+// Returns the first set slot, `m` must not be 0.
+i32 first_set_slot(u64 m) {
+    return count_leading_zeros(m);
+}
+
+// Returns the last slot at or before `slot` that is set, or -1 if there isn't one.
+i32 last_set_slot(u64 m, i32 slot) {
+    assert(0 <= slot);
+    assert(slot < 64);
+    u64 before = m >> (63 - slot);
+    if (!before) {
+        return -1;
+    }
+    return slot - count_trailing_zeros(before);
+}
+
+// PuzzleArgs and Puzzle are in dandd.h.
 
 Puzzle puzzle(PuzzleArgs args) {
     assert(args.monsters_count <= 64);
@@ -125,6 +204,8 @@ Puzzle puzzle(PuzzleArgs args) {
     }
     Puzzle p = (Puzzle){};
     for (i32 i = 0; i < 8; i++) {
+        assert(args.row_wall_counts[i] <= 8);
+        assert(args.col_wall_counts[i] <= 8);
         p.row_wall_counts[i] = args.row_wall_counts[i];
         p.col_wall_counts[i] = args.col_wall_counts[i];
     }
@@ -133,28 +214,40 @@ Puzzle puzzle(PuzzleArgs args) {
     return p;
 }
 
-void print_puzzle(Puzzle puzzle, u64 solution) {
+// Draw a puzzle and a solution into `out` the way `print_puzzle` does, 8 lines of 8 tiles and a
+// newline each (PUZZLE_GRID_LEN chars, with no terminator).
+#define PUZZLE_GRID_LEN 72
+
+void format_puzzle_grid(char *out, Puzzle puzzle, u64 solution) {
     for (u64 i = 0; i < 64; i++) {
         u64 monster = (puzzle.monsters >> (63 - i)) & 1;
         u64 treasure = (puzzle.treasures >> (63 - i)) & 1;
         u64 wall = (solution >> (63 - i)) & 1;
+        char tile = '.';
         if ((monster && treasure) || (monster && wall) || (treasure && wall)) {
-            printf("?");
+            tile = '?';
         } else if (monster) {
-            printf("M");
+            tile = 'M';
         } else if (treasure) {
-            printf("T");
+            tile = 'T';
         } else if (wall) {
-            printf("X");
-        } else {
-            printf(".");
+            tile = 'X';
         }
+        *out++ = tile;
         if (i % 8 == 7) {
-            printf("\n");
+            *out++ = '\n';
         }
     }
 }
 
+#if !defined(DANDD_LIBRARY)
+void print_puzzle(Puzzle puzzle, u64 solution) {
+    char grid[PUZZLE_GRID_LEN];
+    format_puzzle_grid(grid, puzzle, solution);
+    fwrite(grid, 1, PUZZLE_GRID_LEN, stdout);
+}
+#endif
+
 // Constraints.
 // We only check constraints that would apply to the current slot.
 // If they're written correctly and the search proceeds in slot order, then we know they've all been
@@ -181,44 +274,433 @@ i32 count_walls_in_col(u64 solution, i32 col) {
     return walls_in_col;
 }
 
-bool check_row_count(Puzzle puzzle, u64 solution, i32 slot) {
+// Running counts of the walls in each row and column of a partial solution. The searches update
+// these as they set and unset slots so the count constraints don't have to recount the solution.
+typedef struct {
+    u8 row_walls[8];
+    u8 col_walls[8];
+} WallCounts;
+
+void wall_counts_set(WallCounts *counts, i32 slot) {
+    Pos pos = pos_from_slot(slot);
+    counts->row_walls[pos.row]++;
+    counts->col_walls[pos.col]++;
+}
+
+void wall_counts_unset(WallCounts *counts, i32 slot) {
+    Pos pos = pos_from_slot(slot);
+    assert(counts->row_walls[pos.row] > 0);
+    assert(counts->col_walls[pos.col] > 0);
+    counts->row_walls[pos.row]--;
+    counts->col_walls[pos.col]--;
+}
+
+bool check_row_count(Puzzle puzzle, const WallCounts *counts, i32 slot) {
     assert(0 <= slot);
     assert(slot < 64);
 
     Pos pos = pos_from_slot(slot);
-    i32 walls_in_row = count_walls_in_row(solution, pos.row);
-    if (walls_in_row > puzzle.row_wall_counts[pos.row]) {
+    i32 walls_in_row = counts->row_walls[pos.row];
+    i32 wall_count = puzzle.row_wall_counts[pos.row];
+    if (walls_in_row > wall_count) {
         return false;
     }
-    // If we're at the last column, then the count must match exactly.
-    if (pos.col == 7 && walls_in_row != puzzle.row_wall_counts[pos.row]) {
+    // If the rest of the row can't make up the missing walls, it can never match. At the last
+    // column this means the count must match exactly.
+    i32 slots_left_in_row = 7 - pos.col;
+    if (walls_in_row + slots_left_in_row < wall_count) {
         return false;
     }
     return true;
 }
 
-bool check_col_count(Puzzle puzzle, u64 solution, i32 slot) {
+bool check_col_count(Puzzle puzzle, const WallCounts *counts, i32 slot) {
     assert(0 <= slot);
     assert(slot < 64);
 
     Pos pos = pos_from_slot(slot);
-    i32 walls_in_col = count_walls_in_col(solution, pos.col);
-    if (walls_in_col > puzzle.col_wall_counts[pos.col]) {
+    i32 walls_in_col = counts->col_walls[pos.col];
+    i32 wall_count = puzzle.col_wall_counts[pos.col];
+    if (walls_in_col > wall_count) {
         return false;
     }
-    // If we're in the last row, then the count must match exactly.
-    if (pos.row == 7 && walls_in_col != puzzle.col_wall_counts[pos.col]) {
+    // If the rest of the column can't make up the missing walls, it can never match. At the last
+    // row this means the count must match exactly.
+    i32 slots_left_in_col = 7 - pos.row;
+    if (walls_in_col + slots_left_in_col < wall_count) {
         return false;
     }
     return true;
 }
 
+// Precomputed masks for every slot, used by the constraints so they don't have to build them
+// with `pos_set` on every check. Neighbors that are out of bounds are left out of the masks.
+typedef struct {
+    // The (up to) 4 slots bordering the slot.
+    u64 border[64];
+    // The 2x2 space with the slot in the bottom right corner, 0 if it doesn't fit on the board.
+    u64 wide_space[64];
+    // The 12 slots surrounding that 2x2 space.
+    u64 wide_space_neighbors[64];
+    // The 3x3 room centered on the slot, 0 if it doesn't fit on the board.
+    u64 room[64];
+    // The 12 slots that make up the walls of that room (the corners don't count).
+    u64 room_walls[64];
+    // The room centers whose room, or whose walls, include the slot.
+    u64 rooms_containing[64];
+    u64 room_walls_containing[64];
+    // The room centers whose walls are all placed once the search gets to the slot (the slot
+    // where the treasure check starts counting openings strictly).
+    u64 rooms_finished[64];
+    // The slots to check for dead ends and invalid monsters after placing the slot.
+    u64 dead_end_checks[64];
+    u64 monster_checks[64];
+} Masks;
+
+static Masks masks;
+
+// All 256 possible rows of walls, grouped by how many walls they have. Within a group they're
+// sorted from the highest value to the lowest, the same order the slot by slot search finds them.
+typedef struct {
+    u8 patterns[256];
+    // The rows with `n` walls are patterns[start[n]] up to (not including) patterns[start[n + 1]].
+    u16 start[10];
+} RowPatterns;
+
+static RowPatterns row_patterns;
+
+// Run `fn` exactly once, however many threads call this at the same time. The calls that don't
+// run it wait until it's done.
+#if defined(_WIN32)
+typedef INIT_ONCE Once;
+#define ONCE_INIT INIT_ONCE_STATIC_INIT
+
+typedef struct {
+    void (*fn)(void);
+} OnceCall;
+
+static BOOL CALLBACK once_call(PINIT_ONCE once, PVOID arg, PVOID *context) {
+    (void)once;
+    (void)context;
+    ((OnceCall *)arg)->fn();
+    return TRUE;
+}
+
+void run_once(Once *once, void (*fn)(void)) {
+    OnceCall call = {.fn = fn};
+    InitOnceExecuteOnce(once, once_call, &call, NULL);
+}
+#else
+typedef pthread_once_t Once;
+#define ONCE_INIT PTHREAD_ONCE_INIT
+
+void run_once(Once *once, void (*fn)(void)) {
+    pthread_once(once, fn);
+}
+#endif
+
+static Once masks_once = ONCE_INIT;
+
+void build_masks(void) {
+    for (i32 slot = 0; slot < 64; slot++) {
+        Pos p = pos_from_slot(slot);
+
+        u64 border = 0;
+        border = pos_set(border, (Pos){.row = p.row - 1, .col = p.col});
+        border = pos_set(border, (Pos){.row = p.row + 1, .col = p.col});
+        border = pos_set(border, (Pos){.row = p.row, .col = p.col - 1});
+        border = pos_set(border, (Pos){.row = p.row, .col = p.col + 1});
+        masks.border[slot] = border;
+
+        u64 space = 0;
+        space = pos_set(space, p);
+        space = pos_set(space, (Pos){.row = p.row, .col = p.col - 1});
+        space = pos_set(space, (Pos){.row = p.row - 1, .col = p.col});
+        space = pos_set(space, (Pos){.row = p.row - 1, .col = p.col - 1});
+        masks.wide_space[slot] = count_set_bits(space) == 4 ? space : 0;
+
+        u64 neighbors = 0;
+        for (i32 row = p.row - 2; row <= p.row + 1; row++) {
+            for (i32 col = p.col - 2; col <= p.col + 1; col++) {
+                neighbors = pos_set(neighbors, (Pos){.row = row, .col = col});
+            }
+        }
+        masks.wide_space_neighbors[slot] = neighbors & ~space;
+
+        u64 room = 0;
+        for (i32 row = p.row - 1; row <= p.row + 1; row++) {
+            for (i32 col = p.col - 1; col <= p.col + 1; col++) {
+                room = pos_set(room, (Pos){.row = row, .col = col});
+            }
+        }
+        masks.room[slot] = count_set_bits(room) == 9 ? room : 0;
+
+        u64 walls = 0;
+        for (i32 i = -1; i <= 1; i++) {
+            walls = pos_set(walls, (Pos){.row = p.row - 2, .col = p.col + i});
+            walls = pos_set(walls, (Pos){.row = p.row + 2, .col = p.col + i});
+            walls = pos_set(walls, (Pos){.row = p.row + i, .col = p.col - 2});
+            walls = pos_set(walls, (Pos){.row = p.row + i, .col = p.col + 2});
+        }
+        masks.room_walls[slot] = walls;
+
+        Pos above = (Pos){.row = p.row - 1, .col = p.col};
+        Pos left = (Pos){.row = p.row, .col = p.col - 1};
+        masks.dead_end_checks[slot] = pos_set(pos_set(slot_set(0, slot), above), left);
+        u64 monster_checks = pos_set(0, above);
+        if (p.row == 7) {
+            monster_checks = pos_set(monster_checks, left);
+            if (p.col == 7) {
+                monster_checks = slot_set(monster_checks, slot);
+            }
+        }
+        masks.monster_checks[slot] = monster_checks;
+    }
+
+    for (i32 center = 0; center < 64; center++) {
+        if (!masks.room[center]) {
+            continue;
+        }
+        for (i32 slot = 0; slot < 64; slot++) {
+            if (slot_is_set(masks.room[center], slot)) {
+                masks.rooms_containing[slot] = slot_set(masks.rooms_containing[slot], center);
+            }
+            if (slot_is_set(masks.room_walls[center], slot)) {
+                masks.room_walls_containing[slot] =
+                    slot_set(masks.room_walls_containing[slot], center);
+            }
+        }
+        Pos p = pos_from_slot(center);
+        i32 finished = p.row + 2 <= 7 && p.col + 2 <= 7 ? (p.row + 2) * 8 + p.col + 2 : 63;
+        masks.rooms_finished[finished] = slot_set(masks.rooms_finished[finished], center);
+    }
+
+    u16 pattern_i = 0;
+    for (i32 walls = 0; walls <= 8; walls++) {
+        row_patterns.start[walls] = pattern_i;
+        for (i32 pattern = 255; pattern >= 0; pattern--) {
+            if (count_set_bits((u64)pattern) == walls) {
+                row_patterns.patterns[pattern_i++] = (u8)pattern;
+            }
+        }
+    }
+    row_patterns.start[9] = pattern_i;
+}
+
+// Build the mask and row pattern tables. Safe to call more than once and from any thread, only the
+// first call does anything.
+void init_masks(void) {
+    run_once(&masks_once, build_masks);
+}
+
+// Board kernels.
+// The constraints evaluated for every cell of the board at once, in the style of chess engine
+// bitboards. Shifting the board moves the value of every cell onto one of its neighbors, with the
+// cells that would wrap around an edge masked off. Cells off the board are never open.
+
+#define BOARD_ROW_0 ((u64)0xff00000000000000)
+#define BOARD_COL_0 ((u64)0x8080808080808080)
+#define BOARD_COL_7 ((u64)0x0101010101010101)
+#define BOARD_ROW_7 ((u64)0x00000000000000ff)
+
+// These give every cell the value of its neighbor in that direction.
+u64 board_from_above(u64 board) {
+    return board >> 8;
+}
+
+u64 board_from_below(u64 board) {
+    return board << 8;
+}
+
+u64 board_from_left(u64 board) {
+    return (board >> 1) & ~BOARD_COL_0;
+}
+
+u64 board_from_right(u64 board) {
+    return (board << 1) & ~BOARD_COL_7;
+}
+
+// Cells that border any of the cells in `board`.
+u64 board_neighbors(u64 board) {
+    return board_from_above(board) | board_from_below(board) | board_from_left(board) |
+           board_from_right(board);
+}
+
+// The cells of `region` that `seed` can reach without leaving `region`. Grows the seed a cell in
+// every direction at a time until it stops growing.
+u64 board_flood(u64 seed, u64 region) {
+    seed &= region;
+    for (;;) {
+        u64 grown = (seed | board_neighbors(seed)) & region;
+        if (grown == seed) {
+            return seed;
+        }
+        seed = grown;
+    }
+}
+
+// The open cells that aren't in the largest connected group of open cells.
+u64 board_disconnected(u64 open) {
+    u64 largest = 0;
+    for (u64 remaining = open; remaining;) {
+        u64 group = board_flood(slot_set(0, first_set_slot(remaining)), open);
+        remaining &= ~group;
+        if (count_set_bits(group) > count_set_bits(largest)) {
+            largest = group;
+        }
+    }
+    return open & ~largest;
+}
+
+bool board_is_connected(u64 open) {
+    return !open || board_flood(slot_set(0, first_set_slot(open)), open) == open;
+}
+
+// Board symmetries.
+// A board can be flipped and transposed in 8 ways (the 4 rotations, each with and without a
+// mirror) and still follow the same rules, so every puzzle comes with up to 7 equivalent ones.
+// These move every cell at once with delta swaps, swapping groups of bits that are the same
+// distance apart.
+
+#define NUM_SYMMETRIES 8
+
+// Row r goes to row 7 - r.
+u64 board_flip_rows(u64 board) {
+    board = ((board >> 8) & 0x00FF00FF00FF00FF) | ((board & 0x00FF00FF00FF00FF) << 8);
+    board = ((board >> 16) & 0x0000FFFF0000FFFF) | ((board & 0x0000FFFF0000FFFF) << 16);
+    return (board >> 32) | (board << 32);
+}
+
+// Column c goes to column 7 - c.
+u64 board_mirror_cols(u64 board) {
+    board = ((board >> 1) & 0x5555555555555555) | ((board & 0x5555555555555555) << 1);
+    board = ((board >> 2) & 0x3333333333333333) | ((board & 0x3333333333333333) << 2);
+    return ((board >> 4) & 0x0F0F0F0F0F0F0F0F) | ((board & 0x0F0F0F0F0F0F0F0F) << 4);
+}
+
+// The cell at row r, column c goes to row c, column r.
+u64 board_transpose(u64 board) {
+    u64 t = 0x0F0F0F0F00000000 & (board ^ (board << 28));
+    board ^= t ^ (t >> 28);
+    t = 0x3333000033330000 & (board ^ (board << 14));
+    board ^= t ^ (t >> 14);
+    t = 0x5500550055005500 & (board ^ (board << 7));
+    board ^= t ^ (t >> 7);
+    return board;
+}
+
+// Apply one of the 8 symmetries. Bit 2 of `symmetry` transposes, then bit 1 flips the rows and
+// bit 0 mirrors the columns. 0 leaves the board as it is.
+u64 board_transform(u64 board, i32 symmetry) {
+    if (symmetry & 4) {
+        board = board_transpose(board);
+    }
+    if (symmetry & 2) {
+        board = board_flip_rows(board);
+    }
+    if (symmetry & 1) {
+        board = board_mirror_cols(board);
+    }
+    return board;
+}
+
+// Apply a symmetry to a whole puzzle, with its wall counts.
+Puzzle puzzle_transform(Puzzle puzzle, i32 symmetry) {
+    Puzzle result = {.monsters = board_transform(puzzle.monsters, symmetry),
+                     .treasures = board_transform(puzzle.treasures, symmetry)};
+    for (i32 i = 0; i < 8; i++) {
+        u8 row_count = symmetry & 4 ? puzzle.col_wall_counts[i] : puzzle.row_wall_counts[i];
+        u8 col_count = symmetry & 4 ? puzzle.row_wall_counts[i] : puzzle.col_wall_counts[i];
+        result.row_wall_counts[symmetry & 2 ? 7 - i : i] = row_count;
+        result.col_wall_counts[symmetry & 1 ? 7 - i : i] = col_count;
+    }
+    return result;
+}
+
+// Cells with at least 2 open neighbors.
+u64 board_two_open_neighbors(u64 open) {
+    u64 above = board_from_above(open);
+    u64 below = board_from_below(open);
+    u64 left = board_from_left(open);
+    u64 right = board_from_right(open);
+    // Add up the 4 neighbors bitwise, 2 half adders and then check for any carries.
+    u64 sum0 = above ^ below;
+    u64 carry0 = above & below;
+    u64 sum1 = left ^ right;
+    u64 carry1 = left & right;
+    return carry0 | carry1 | (sum0 & sum1);
+}
+
+// Cells with exactly 1 open neighbor.
+u64 board_one_open_neighbor(u64 open) {
+    u64 above = board_from_above(open);
+    u64 below = board_from_below(open);
+    u64 left = board_from_left(open);
+    u64 right = board_from_right(open);
+    u64 sum0 = above ^ below;
+    u64 carry0 = above & below;
+    u64 sum1 = left ^ right;
+    u64 carry1 = left & right;
+    return (sum0 ^ sum1) & ~(carry0 | carry1);
+}
+
+// Cells with at least 3 open neighbors.
+u64 board_three_open_neighbors(u64 open) {
+    u64 above = board_from_above(open);
+    u64 below = board_from_below(open);
+    u64 left = board_from_left(open);
+    u64 right = board_from_right(open);
+    // The full sum this time, bit 2 is only set when all 4 are.
+    u64 sum0 = above ^ below;
+    u64 carry0 = above & below;
+    u64 sum1 = left ^ right;
+    u64 carry1 = left & right;
+    u64 bit0 = sum0 ^ sum1;
+    u64 bit1 = carry0 ^ carry1 ^ (sum0 & sum1);
+    u64 bit2 = carry0 & carry1;
+    return bit2 | (bit1 & bit0);
+}
+
+// The bottom right corners of 2x2 spaces that are allowed to be open because they have a treasure
+// around them.
+u64 board_allowed_wide_spaces(u64 treasures) {
+    // Spread the treasures over the 4x4 area around each space's corner, 2 columns to the left and
+    // 1 to the right, then 2 rows up and 1 down.
+    u64 t = treasures;
+    u64 spread = t | board_from_left(t) | board_from_left(board_from_left(t)) | board_from_right(t);
+    return spread | board_from_above(spread) | board_from_above(board_from_above(spread)) |
+           board_from_below(spread);
+}
+
+// Open cells without a monster or treasure that have 1 or less open neighbors.
+u64 board_dead_ends(Puzzle puzzle, u64 solution) {
+    u64 open = ~solution;
+    u64 empty = open & ~(puzzle.monsters | puzzle.treasures);
+    return empty & ~board_two_open_neighbors(open);
+}
+
+// Monsters that border a monster or treasure, or don't have exactly one open neighbor.
+u64 board_invalid_monsters(Puzzle puzzle, u64 solution) {
+    u64 open = ~solution;
+    u64 next_to_occupied = board_neighbors(puzzle.monsters | puzzle.treasures);
+    return puzzle.monsters & (next_to_occupied | ~board_one_open_neighbor(open));
+}
+
+// The bottom right corners of 2x2 spaces of open cells without monsters or treasures that don't
+// have a treasure around them.
+u64 board_invalid_wide_spaces(Puzzle puzzle, u64 solution) {
+    u64 empty = ~solution & ~(puzzle.monsters | puzzle.treasures);
+    u64 columns = empty & board_from_above(empty);
+    u64 spaces = columns & board_from_left(columns);
+    return spaces & ~board_allowed_wide_spaces(puzzle.treasures);
+}
+
 bool is_dead_end(Puzzle puzzle, u64 solution, Pos p) {
     if (p.row < 0 || p.row >= 8 || p.col < 0 || p.col >= 8) {
         return false;
     }
-    u64 slot_mask = 0;
-    slot_mask = pos_set(slot_mask, p);
+    i32 slot = p.row * 8 + p.col;
+    u64 slot_mask = slot_set(0, slot);
     // If there's a wall here it's not a dead end.
     if (slot_mask & solution) {
         return false;
@@ -227,11 +709,7 @@ bool is_dead_end(Puzzle puzzle, u64 solution, Pos p) {
     if (slot_mask & puzzle.treasures || slot_mask & puzzle.monsters) {
         return false;
     }
-    u64 border_mask = 0;
-    border_mask = pos_set(border_mask, (Pos){.row = p.row - 1, .col = p.col});
-    border_mask = pos_set(border_mask, (Pos){.row = p.row + 1, .col = p.col});
-    border_mask = pos_set(border_mask, (Pos){.row = p.row, .col = p.col - 1});
-    border_mask = pos_set(border_mask, (Pos){.row = p.row, .col = p.col + 1});
+    u64 border_mask = masks.border[slot];
     u64 border_walls = border_mask & solution;
     // If there are 1 or less open spaces around the slot, this is a dead end.
     return count_set_bits(border_walls) >= count_set_bits(border_mask) - 1;
@@ -239,87 +717,43 @@ bool is_dead_end(Puzzle puzzle, u64 solution, Pos p) {
 
 bool check_dead_ends(Puzzle puzzle, u64 solution, i32 slot) {
     // Check this slot, the slot to the left and the slot above for dead ends.
-    Pos p = pos_from_slot(slot);
-    Pos above = (Pos){.row = p.row - 1, .col = p.col};
-    Pos left = (Pos){.row = p.row, .col = p.col - 1};
-    if (is_dead_end(puzzle, solution, above) || is_dead_end(puzzle, solution, left) ||
-        is_dead_end(puzzle, solution, p)) {
-        return false;
-    }
-    return true;
+    return !(board_dead_ends(puzzle, solution) & masks.dead_end_checks[slot]);
 }
 
+// Whether the monster at `p` is already invalid, with the walls placed up to `p`. The cells after
+// it are still unknown, so it only has too many ways out once two of the cells before it are open.
 bool is_invalid_monster(Puzzle puzzle, u64 solution, Pos p) {
     if (p.row < 0 || p.row >= 8 || p.col < 0 || p.col >= 8) {
         return false;
     }
-    u64 slot_mask = 0;
-    slot_mask = pos_set(slot_mask, p);
+    i32 slot = p.row * 8 + p.col;
+    u64 slot_mask = slot_set(0, slot);
     // If there's no monster here, it's valid.
     if (!(slot_mask & puzzle.monsters)) {
         return false;
     }
-    u64 border_mask = 0;
-    border_mask = pos_set(border_mask, (Pos){.row = p.row - 1, .col = p.col});
-    border_mask = pos_set(border_mask, (Pos){.row = p.row + 1, .col = p.col});
-    border_mask = pos_set(border_mask, (Pos){.row = p.row, .col = p.col - 1});
-    border_mask = pos_set(border_mask, (Pos){.row = p.row, .col = p.col + 1});
-    u64 border_walls = border_mask & solution;
+    u64 border_mask = masks.border[slot];
     // Monsters can't border monsters or treasures.
     if (border_mask & puzzle.monsters || border_mask & puzzle.treasures) {
         return true;
     }
-    return count_set_bits(border_walls) != count_set_bits(border_mask) - 1;
+    u64 placed = ~(u64)0 << (63 - slot);
+    i32 open = count_set_bits(border_mask & placed & ~solution);
+    return open > 1 || (open == 0 && !(border_mask & ~placed));
 }
 
 bool check_monsters(Puzzle puzzle, u64 solution, i32 slot) {
-    // Check monster above.
-    Pos p = pos_from_slot(slot);
-    Pos above = (Pos){.row = p.row - 1, .col = p.col};
-    if (is_invalid_monster(puzzle, solution, above)) {
-        return false;
-    }
-    if (p.row == 7) {
-        // Check monster to the left.
-        Pos left = (Pos){.row = p.row, .col = p.col - 1};
-        if (is_invalid_monster(puzzle, solution, left)) {
-            return false;
-        }
-        if (p.col == 7) {
-            // Check monster here.
-            if (is_invalid_monster(puzzle, solution, p)) {
-                return false;
-            }
-        }
-    }
-    return true;
+    // Check the monster above, and on the last row the monster to the left and the one here.
+    return !(board_invalid_monsters(puzzle, solution) & masks.monster_checks[slot]);
 }
 
 bool check_wide_space(Puzzle puzzle, u64 solution, i32 slot) {
-    Pos p = pos_from_slot(slot);
-    u64 space_mask = 0;
-    space_mask = pos_set(space_mask, p);
-    space_mask = pos_set(space_mask, (Pos){.row = p.row, .col = p.col - 1});
-    space_mask = pos_set(space_mask, (Pos){.row = p.row - 1, .col = p.col});
-    space_mask = pos_set(space_mask, (Pos){.row = p.row - 1, .col = p.col - 1});
-    if (count_set_bits(space_mask) == 4 && !(space_mask & solution) &&
-        !(space_mask & puzzle.monsters) && !(space_mask & puzzle.treasures)) {
+    u64 space_mask = masks.wide_space[slot];
+    if (space_mask && !(space_mask & solution) && !(space_mask & puzzle.monsters) &&
+        !(space_mask & puzzle.treasures)) {
         // If we're in a treasure room, then a wide space is ok.
         // Check neighbors for a treasure, if there isn't one, then this is a violation.
-        u64 neighbors = 0;
-        neighbors = pos_set(neighbors, (Pos){.row = p.row - 2, .col = p.col - 2});
-        neighbors = pos_set(neighbors, (Pos){.row = p.row - 2, .col = p.col - 1});
-        neighbors = pos_set(neighbors, (Pos){.row = p.row - 2, .col = p.col});
-        neighbors = pos_set(neighbors, (Pos){.row = p.row - 2, .col = p.col + 1});
-        neighbors = pos_set(neighbors, (Pos){.row = p.row - 1, .col = p.col - 2});
-        neighbors = pos_set(neighbors, (Pos){.row = p.row - 1, .col = p.col + 1});
-        neighbors = pos_set(neighbors, (Pos){.row = p.row, .col = p.col - 2});
-        neighbors = pos_set(neighbors, (Pos){.row = p.row, .col = p.col + 1});
-        neighbors = pos_set(neighbors, (Pos){.row = p.row + 1, .col = p.col - 2});
-        neighbors = pos_set(neighbors, (Pos){.row = p.row + 1, .col = p.col - 1});
-        neighbors = pos_set(neighbors, (Pos){.row = p.row + 1, .col = p.col});
-        neighbors = pos_set(neighbors, (Pos){.row = p.row + 1, .col = p.col + 1});
-        if (neighbors & puzzle.treasures) {
+        if (masks.wide_space_neighbors[slot] & puzzle.treasures) {
             return true;
         }
         return false;
@@ -327,18 +761,62 @@ bool check_wide_space(Puzzle puzzle, u64 solution, i32 slot) {
     return true;
 }
 
+// The generator's version of `check_wide_space`. A room's treasure can come after its first 2x2
+// space, so a space is fine while one of the rooms around it could still be a treasure room: no
+// walls or monsters inside, at most one way in so far, and a treasure or a cell that could still
+// get one. Every space in the rows above gets checked again at the end of a row, once all the
+// cells around it are placed.
+bool check_generated_wide_space(Puzzle puzzle, u64 solution, i32 slot) {
+    u64 placed = ~(u64)0 << (63 - slot);
+    u64 space_mask = masks.wide_space[slot];
+    if (space_mask && !(space_mask & (solution | puzzle.monsters | puzzle.treasures))) {
+        u64 open = ~solution & placed;
+        u64 centers = masks.rooms_containing[slot] & masks.rooms_containing[slot - 9];
+        bool possible = false;
+        while (centers && !possible) {
+            i32 center = first_set_slot(centers);
+            centers = slot_unset(centers, center);
+            u64 room = masks.room[center];
+            possible = !(room & (solution | puzzle.monsters)) &&
+                       (room & (puzzle.treasures | ~placed)) &&
+                       count_set_bits(masks.room_walls[center] & open) <= 1;
+        }
+        if (!possible) {
+            return false;
+        }
+    }
+    if (slot % 8 != 7 || slot < 15) {
+        return true;
+    }
+    u64 finished = slot == 63 ? ~(u64)0 : ~(u64)0 << (71 - slot);
+    return !(board_invalid_wide_spaces(puzzle, solution) & finished);
+}
+
+// All the open cells have to be connected. This only checks when a row is finished, the cells
+// after it count as open and are all connected to each other. If some open cells in the finished
+// rows can't reach them, they're cut off for good: that's only allowed if they're all the open
+// cells there are, so nothing else can reach them either.
+bool check_connected(u64 solution, i32 slot) {
+    if (slot % 8 != 7) {
+        return true;
+    }
+    u64 placed = ~(u64)0 << (63 - slot);
+    u64 open = ~solution & placed;
+    u64 below = ~placed;
+    u64 cut_off = open & ~board_flood(below, open | below);
+    if (!cut_off) {
+        return true;
+    }
+    return cut_off == open && board_is_connected(cut_off);
+}
+
 bool is_invalid_treasure_room(Puzzle puzzle, u64 solution, Pos treasure, Pos center, i32 slot) {
-    u64 room_mask = 0;
-    room_mask = pos_set(room_mask, (Pos){.row = center.row - 1, .col = center.col - 1});
-    room_mask = pos_set(room_mask, (Pos){.row = center.row - 1, .col = center.col});
-    room_mask = pos_set(room_mask, (Pos){.row = center.row - 1, .col = center.col + 1});
-    room_mask = pos_set(room_mask, (Pos){.row = center.row, .col = center.col - 1});
-    room_mask = pos_set(room_mask, (Pos){.row = center.row, .col = center.col});
-    room_mask = pos_set(room_mask, (Pos){.row = center.row, .col = center.col + 1});
-    room_mask = pos_set(room_mask, (Pos){.row = center.row + 1, .col = center.col - 1});
-    room_mask = pos_set(room_mask, (Pos){.row = center.row + 1, .col = center.col});
-    room_mask = pos_set(room_mask, (Pos){.row = center.row + 1, .col = center.col + 1});
-    if (count_set_bits(room_mask) != 9) {
+    if (center.row < 0 || center.row >= 8 || center.col < 0 || center.col >= 8) {
+        return true;
+    }
+    i32 center_slot = center.row * 8 + center.col;
+    u64 room_mask = masks.room[center_slot];
+    if (!room_mask) {
         return true;
     }
     u64 other_treasures = pos_unset(puzzle.treasures, treasure);
@@ -348,19 +826,7 @@ bool is_invalid_treasure_room(Puzzle puzzle, u64 solution, Pos treasure, Pos cen
     if (room_mask & solution) {
         return true;
     }
-    u64 walls_mask = 0;
-    walls_mask = pos_set(walls_mask, (Pos){.row = center.row - 2, .col = center.col - 1});
-    walls_mask = pos_set(walls_mask, (Pos){.row = center.row - 2, .col = center.col});
-    walls_mask = pos_set(walls_mask, (Pos){.row = center.row - 2, .col = center.col + 1});
-    walls_mask = pos_set(walls_mask, (Pos){.row = center.row + 2, .col = center.col - 1});
-    walls_mask = pos_set(walls_mask, (Pos){.row = center.row + 2, .col = center.col});
-    walls_mask = pos_set(walls_mask, (Pos){.row = center.row + 2, .col = center.col + 1});
-    walls_mask = pos_set(walls_mask, (Pos){.row = center.row - 1, .col = center.col - 2});
-    walls_mask = pos_set(walls_mask, (Pos){.row = center.row, .col = center.col - 2});
-    walls_mask = pos_set(walls_mask, (Pos){.row = center.row + 1, .col = center.col - 2});
-    walls_mask = pos_set(walls_mask, (Pos){.row = center.row - 1, .col = center.col + 2});
-    walls_mask = pos_set(walls_mask, (Pos){.row = center.row, .col = center.col + 2});
-    walls_mask = pos_set(walls_mask, (Pos){.row = center.row + 1, .col = center.col + 2});
+    u64 walls_mask = masks.room_walls[center_slot];
     if (walls_mask & puzzle.monsters || walls_mask & puzzle.treasures) {
         return true;
     }
@@ -372,8 +838,10 @@ bool is_invalid_treasure_room(Puzzle puzzle, u64 solution, Pos treasure, Pos cen
             return true;
         }
     } else {
-        // Only know it's invalid if there's no opening.
-        if (count_set_bits(walls_mask & solution) == count_set_bits(walls_mask)) {
+        // Only know it's invalid if there's no opening, or if there are already two.
+        u64 placed = ~(u64)0 << (63 - slot);
+        if (count_set_bits(walls_mask & solution) == count_set_bits(walls_mask) ||
+            count_set_bits(walls_mask & placed & ~solution) > 1) {
             return true;
         }
     }
@@ -392,12 +860,13 @@ bool is_invalid_treasure(Puzzle puzzle, u64 solution, Pos treasure, i32 slot) {
     return result;
 }
 
-// @opt(steve): This one is more expensive so we could pre-compute these masks.
 bool check_treasure_rooms(Puzzle puzzle, u64 solution, i32 slot) {
     if (puzzle.treasures == 0) {
         return true;
     }
     // @opt(steve): Probably don't have to check every treasure room each time.
+    // @note(steve): The solver keeps a TreasureState instead, the generator still uses this since
+    // its treasures move.
     for (i32 row = 0; row < 8; row++) {
         for (i32 col = 0; col < 8; col++) {
             Pos treasure_pos = (Pos){.row = row, .col = col};
@@ -411,176 +880,6470 @@ bool check_treasure_rooms(Puzzle puzzle, u64 solution, i32 slot) {
     return true;
 }
 
-// Solve a puzzle
-// Pushes all found solutions into the passed in `solutions` pointer which is assumed to
-// be an empty array with length max_solutions. Returns the number of solutions found.
-// The solution space has 2^64 possible solutions, this is a big number that can't fit in a 64-bit
-// int.
-// The search for solutions uses all the constraints as it goes so it doesn't have to check all
-// of these.
-u64 solve(Puzzle puzzle, u64 *solutions, u64 max_solutions) {
-    u64 solution_i = 0;
-
-    u64 solution = 0;
-    i32 slot = 0;
+// Treasure rooms for the solver.
+// When solving, the treasures don't move, so instead of checking every room of every treasure at
+// each slot the solver keeps the room centers that could still work and rules them out as it goes.
+// A center is ruled out when a wall lands in its room, when its walls close it in or when all of
+// its walls are placed without exactly one opening. Those only depend on slots that are already
+// placed, so a center stays ruled out for the rest of the search below that slot, and backtracking
+// just goes back to the snapshot from before it.
+typedef struct {
+    u64 treasures;
+    // The centers each treasure could have its room at before any walls are placed, indexed by
+    // the treasure's slot.
+    u64 treasure_centers[64];
+    // The centers that are still possible before each slot is placed.
+    u64 centers[65];
+    // Set if a treasure in the prefix already can't have a room.
+    bool impossible;
+} TreasureState;
 
-    while (0 <= slot && slot < 64) {
-        if (!slot_is_set(solution, slot)) {
-            solution = slot_set(solution, slot);
-        } else {
-            solution = slot_unset(solution, slot);
+// The centers that are still possible after placing `slot`.
+u64 treasure_centers_after(u64 centers, u64 solution, i32 slot) {
+    u64 ruled_out = 0;
+    if (slot_is_set(solution, slot)) {
+        ruled_out |= centers & masks.rooms_containing[slot];
+        u64 closing = centers & masks.room_walls_containing[slot] & ~ruled_out;
+        while (closing) {
+            i32 center = first_set_slot(closing);
+            closing = slot_unset(closing, center);
+            if (!(masks.room_walls[center] & ~solution)) {
+                ruled_out = slot_set(ruled_out, center);
+            }
+        }
+    }
+    u64 finished = centers & masks.rooms_finished[slot] & ~ruled_out;
+    while (finished) {
+        i32 center = first_set_slot(finished);
+        finished = slot_unset(finished, center);
+        if (count_set_bits(masks.room_walls[center] & ~solution) != 1) {
+            ruled_out = slot_set(ruled_out, center);
         }
+    }
+    return centers & ~ruled_out;
+}
 
-        // Check constraints.
-        if (check_doesnt_overlap(puzzle, solution) && check_row_count(puzzle, solution, slot) &&
-            check_col_count(puzzle, solution, slot) && check_dead_ends(puzzle, solution, slot) &&
-            check_monsters(puzzle, solution, slot) && check_wide_space(puzzle, solution, slot) &&
-            check_treasure_rooms(puzzle, solution, slot)) {
+// Update the possible centers for placing the slots from `first_slot` up to (not including)
+// `end_slot`, and check every treasure can still have a room.
+bool treasure_state_check_slots(TreasureState *state, u64 solution, i32 first_slot,
+                                i32 end_slot) {
+    if (!state->treasures) {
+        return true;
+    }
+    if (state->impossible) {
+        return false;
+    }
+    u64 before = state->centers[first_slot];
+    u64 centers = before;
+    for (i32 slot = first_slot; slot < end_slot; slot++) {
+        centers = treasure_centers_after(centers, solution, slot);
+        state->centers[slot + 1] = centers;
+    }
+    if (centers == before) {
+        return true;
+    }
+    u64 treasures = state->treasures;
+    while (treasures) {
+        i32 treasure = first_set_slot(treasures);
+        treasures = slot_unset(treasures, treasure);
+        if (!(state->treasure_centers[treasure] & centers)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-            // Move on to the next slot.
-            if (slot < 63) {
-                slot++;
-                continue;
-            }
+bool treasure_state_check(TreasureState *state, u64 solution, i32 slot) {
+    return treasure_state_check_slots(state, solution, slot, slot + 1);
+}
 
-            // This is a valid solution!
-            // Record it but don't increment slot, we want to backtrack and keep searching for
-            // more.
-            // @opt(steve): Could pass a flag to stop at the first solution if that's all we want.
-            if (solution_i >= max_solutions) {
-                if (solution_i == max_solutions) {
-                    printf("Hit max solutions, no longer recording them.\n");
+// Start tracking the rooms for a search with the slots before `first_slot` fixed to `prefix`.
+void treasure_state_init(TreasureState *state, Puzzle puzzle, u64 prefix, i32 first_slot) {
+    state->treasures = puzzle.treasures;
+    state->impossible = false;
+    u64 centers = 0;
+    u64 treasures = puzzle.treasures;
+    while (treasures) {
+        i32 treasure = first_set_slot(treasures);
+        treasures = slot_unset(treasures, treasure);
+        Pos t = pos_from_slot(treasure);
+        u64 other_treasures = slot_unset(puzzle.treasures, treasure);
+        u64 treasure_centers = 0;
+        // The rooms that don't depend on the walls, the same as `is_invalid_treasure_room`.
+        for (i32 row = t.row - 1; row <= t.row + 1; row++) {
+            for (i32 col = t.col - 1; col <= t.col + 1; col++) {
+                if (row < 0 || row >= 8 || col < 0 || col >= 8) {
+                    continue;
+                }
+                i32 center = row * 8 + col;
+                u64 room = masks.room[center];
+                if (room && !(room & (puzzle.monsters | other_treasures)) &&
+                    !(masks.room_walls[center] & (puzzle.monsters | puzzle.treasures))) {
+                    treasure_centers = slot_set(treasure_centers, center);
                 }
-            } else {
-                solutions[solution_i] = solution;
             }
-            solution_i++;
         }
-
-        // Backtrack to the last set slot (which could be this one).
-        while (slot >= 0 && !slot_is_set(solution, slot)) {
-            slot--;
+        state->treasure_centers[treasure] = treasure_centers;
+        centers |= treasure_centers;
+        if (!treasure_centers) {
+            state->impossible = true;
         }
     }
+    state->centers[0] = centers;
+    if (!state->impossible && first_slot > 0 &&
+        !treasure_state_check_slots(state, prefix, 0, first_slot)) {
+        state->impossible = true;
+    }
+}
 
-    return solution_i;
+// Full solution checks.
+// These check a whole board at once with no search, for checking solutions that come from
+// somewhere else. Every rule is a few whole board operations, except for the treasure rooms which
+// look at the (at most 9) rooms each treasure could be in.
+
+#define BOARD_BYTES_LOW ((u64)0x0101010101010101)
+
+// The number of set bits in each byte.
+u64 board_byte_counts(u64 board) {
+    board = board - ((board >> 1) & 0x5555555555555555);
+    board = (board & 0x3333333333333333) + ((board >> 2) & 0x3333333333333333);
+    return (board + (board >> 4)) & 0x0F0F0F0F0F0F0F0F;
 }
 
-typedef struct {
-    Puzzle puzzle;
-    u64 num_solutions;
-} GeneratedPuzzle;
+// Every cell of the bytes that aren't 0.
+u64 board_nonzero_bytes(u64 board) {
+    board |= board >> 4;
+    board |= board >> 2;
+    board |= board >> 1;
+    return (board & BOARD_BYTES_LOW) * 0xFF;
+}
 
-// Generate valid puzzles.
-// Pushes all found puzzles into the passed in `puzzles` pointer which is assumed to
-// be an empty array with length max_puzzles.
-// Returns the number of puzzles found.
-// Uses a similar strategy to the solver, searches through the puzzle space for valid puzzles.
-// Puzzle space here is an empty tile, a wall, a monster or a treasure for every slot.
-// The row and col counts are simply derived from a valid puzzle.
-// This means there are 4^64 elements in puzzle space, which is much larger than the solution space
-// for a specific puzzle, though obviously most of them are not valid.
-u64 generate(GeneratedPuzzle *puzzles, u64 max_puzzles) {
-    typedef enum { EMPTY = 0, WALL = 1, MONSTER = 2, TREASURE = 3 } Tile;
-    u64 puzzle_i = 0;
+// The rows (and columns) of a board with a byte each, counts[0] in the top byte.
+u64 board_bytes(const u8 counts[8]) {
+    u64 bytes = 0;
+    for (i32 i = 0; i < 8; i++) {
+        bytes |= (u64)counts[i] << (56 - 8 * i);
+    }
+    return bytes;
+}
 
-    Tile puzzle_tiles[64] = {0};
-    Puzzle puzzle = {.row_wall_counts = {0, 0, 0, 0, 0, 0, 0},
-                     .col_wall_counts = {0, 0, 0, 0, 0, 0, 0},
-                     .monsters = 0,
-                     .treasures = 0};
-    u64 solution = 0;
-    i32 slot = 0;
+// Treasures that don't have a valid room, with all of the walls placed.
+u64 board_invalid_treasures(const Puzzle *puzzle, u64 solution) {
+    u64 occupied = puzzle->monsters | puzzle->treasures;
+    u64 invalid = 0;
+    u64 treasures = puzzle->treasures;
+    while (treasures) {
+        i32 treasure = first_set_slot(treasures);
+        treasures = slot_unset(treasures, treasure);
+        u64 others = slot_unset(occupied, treasure);
+        bool has_room = false;
+        u64 centers = masks.rooms_containing[treasure];
+        while (centers && !has_room) {
+            i32 center = first_set_slot(centers);
+            centers = slot_unset(centers, center);
+            u64 room_walls = masks.room_walls[center];
+            has_room = !(masks.room[center] & (others | solution)) && !(room_walls & occupied) &&
+                       count_set_bits(room_walls & ~solution) == 1;
+        }
+        if (!has_room) {
+            invalid = slot_set(invalid, treasure);
+        }
+    }
+    return invalid;
+}
 
-    while (0 <= slot && slot < 64) {
-        // Undo previous tile and choose next option.
-        switch (puzzle_tiles[slot]) {
-        case TREASURE: {
-            puzzle_tiles[slot] = MONSTER;
-            puzzle.treasures = slot_unset(puzzle.treasures, slot);
-            puzzle.monsters = slot_set(puzzle.monsters, slot);
-        } break;
-        case MONSTER: {
-            puzzle_tiles[slot] = WALL;
-            puzzle.monsters = slot_unset(puzzle.monsters, slot);
+// The cells that break a rule: walls on monsters or treasures, every cell of a row or column with
+// the wrong number of walls, dead ends, monsters that don't have exactly one way out (or that
+// border a monster or treasure), all 4 cells of wide spaces outside treasure rooms, treasures
+// without a room and the open cells cut off from the largest open area. 0 if the solution is
+// valid.
+u64 validate_solution_cells(const Puzzle *puzzle, u64 solution) {
+    init_masks();
+    u64 invalid = solution & (puzzle->monsters | puzzle->treasures);
+
+    u64 wrong_rows = board_byte_counts(solution) ^ board_bytes(puzzle->row_wall_counts);
+    u64 wrong_cols =
+        board_byte_counts(board_transpose(solution)) ^ board_bytes(puzzle->col_wall_counts);
+    invalid |= board_nonzero_bytes(wrong_rows) | board_transpose(board_nonzero_bytes(wrong_cols));
+
+    invalid |= board_dead_ends(*puzzle, solution) | board_invalid_monsters(*puzzle, solution);
+    // Wide spaces are marked by their bottom right corner.
+    u64 wide_spaces = board_invalid_wide_spaces(*puzzle, solution);
+    wide_spaces |= board_from_right(wide_spaces);
+    invalid |= wide_spaces | board_from_below(wide_spaces);
+
+    invalid |= board_invalid_treasures(puzzle, solution);
+    return invalid | board_disconnected(~solution);
+}
+
+// Check a full solution against all the rules at once. The same as `validate_solution_cells`
+// returning 0, but it stops at the first rule that's broken.
+bool validate_solution(const Puzzle *puzzle, u64 solution) {
+    init_masks();
+    if (solution & (puzzle->monsters | puzzle->treasures)) {
+        return false;
+    }
+    if (board_byte_counts(solution) != board_bytes(puzzle->row_wall_counts) ||
+        board_byte_counts(board_transpose(solution)) != board_bytes(puzzle->col_wall_counts)) {
+        return false;
+    }
+    if (board_dead_ends(*puzzle, solution) | board_invalid_monsters(*puzzle, solution) |
+        board_invalid_wide_spaces(*puzzle, solution)) {
+        return false;
+    }
+    return !board_invalid_treasures(puzzle, solution) && board_is_connected(~solution);
+}
+
+bool validate(Puzzle puzzle, u64 solution) {
+    return validate_solution(&puzzle, solution);
+}
+
+// Search statistics.
+// Build with DANDD_STATS defined to count what the solver and generator searches do. Without it
+// the counting compiles away and the stats passed in are left as they were.
+
+typedef enum {
+    CHECK_OVERLAP,
+    CHECK_ROW_COUNT,
+    CHECK_COL_COUNT,
+    CHECK_DEAD_ENDS,
+    CHECK_MONSTERS,
+    CHECK_WIDE_SPACE,
+    CHECK_TREASURE_ROOMS,
+    CHECK_INVALID_MONSTER,
+    CHECK_GENERATED_WIDE_SPACE,
+    CHECK_CONNECTED,
+    NUM_CHECKS,
+} Check;
+
+const char *check_names[NUM_CHECKS] = {
+    [CHECK_OVERLAP] = "overlap",
+    [CHECK_ROW_COUNT] = "row_count",
+    [CHECK_COL_COUNT] = "col_count",
+    [CHECK_DEAD_ENDS] = "dead_ends",
+    [CHECK_MONSTERS] = "monsters",
+    [CHECK_WIDE_SPACE] = "wide_space",
+    [CHECK_TREASURE_ROOMS] = "treasure_rooms",
+    [CHECK_INVALID_MONSTER] = "invalid_monster",
+    [CHECK_GENERATED_WIDE_SPACE] = "generated_wide_space",
+    [CHECK_CONNECTED] = "connected",
+};
+
+typedef struct {
+    // Every value tried for a slot.
+    u64 nodes;
+    // Every time the search had to go back to an earlier slot.
+    u64 backtracks;
+    // The most slots filled in at once.
+    i32 max_depth;
+    // How many times each check ran, and how many times it rejected a value.
+    u64 evaluations[NUM_CHECKS];
+    u64 rejections[NUM_CHECKS];
+} SolveStats;
+
+void stats_node(SolveStats *stats, i32 depth) {
+    if (stats) {
+        stats->nodes++;
+        if (depth > stats->max_depth) {
+            stats->max_depth = depth;
+        }
+    }
+}
+
+void stats_backtrack(SolveStats *stats, i32 from_slot, i32 to_slot) {
+    if (stats && to_slot < from_slot) {
+        stats->backtracks++;
+    }
+}
+
+void stats_evaluate(SolveStats *stats, Check check) {
+    if (stats) {
+        stats->evaluations[check]++;
+    }
+}
+
+// Always returns false so it can be chained after a check that failed.
+bool stats_reject(SolveStats *stats, Check check) {
+    if (stats) {
+        stats->rejections[check]++;
+    }
+    return false;
+}
+
+void stats_add(SolveStats *to, const SolveStats *from) {
+    to->nodes += from->nodes;
+    to->backtracks += from->backtracks;
+    if (from->max_depth > to->max_depth) {
+        to->max_depth = from->max_depth;
+    }
+    for (i32 i = 0; i < NUM_CHECKS; i++) {
+        to->evaluations[i] += from->evaluations[i];
+        to->rejections[i] += from->rejections[i];
+    }
+}
+
+#if !defined(DANDD_LIBRARY)
+void print_solve_stats(const char *name, const SolveStats *stats) {
+    printf("%s: %" PRIu64 " nodes, %" PRIu64 " backtracks, max depth %" PRIi32 "\n", name,
+           stats->nodes, stats->backtracks, stats->max_depth);
+    for (i32 i = 0; i < NUM_CHECKS; i++) {
+        if (stats->evaluations[i]) {
+            printf("  %-16s %12" PRIu64 " evaluations %12" PRIu64 " rejections (%5.1f%%)\n",
+                   check_names[i], stats->evaluations[i], stats->rejections[i],
+                   100.0 * (double)stats->rejections[i] / (double)stats->evaluations[i]);
+        }
+    }
+}
+#endif
+
+#if defined(DANDD_STATS)
+#define STATS_NODE(stats, depth) stats_node(stats, depth)
+#define STATS_BACKTRACK(stats, from_slot, to_slot) stats_backtrack(stats, from_slot, to_slot)
+#define STATS_CHECK(stats, check, passed)                                                          \
+    (stats_evaluate(stats, check), (passed) || stats_reject(stats, check))
+#else
+#define STATS_NODE(stats, depth) ((void)(stats), (void)(depth))
+#define STATS_BACKTRACK(stats, from_slot, to_slot)                                                 \
+    ((void)(stats), (void)(from_slot), (void)(to_slot))
+#define STATS_CHECK(stats, check, passed) ((void)(stats), (passed))
+#endif
+
+// Check pipelines.
+// The solver and the generator run their checks in the order in a pipeline and stop at the first
+// one that fails. Checks that are cheap and reject a lot should go first. Build with
+// DANDD_DEBUG_CHECKS to run every check even after one fails and keep all of the results, which is
+// easier to look at in a debugger.
+
+typedef struct {
+    Check order[NUM_CHECKS];
+    i32 num_checks;
+} CheckPipeline;
+
+// The checks the solver runs, cheapest first, each with the expression that runs it in terms of
+// `run_solve_checks`' arguments. The counts are a couple of compares, dead ends, monsters and wide
+// spaces are a few mask lookups, treasure rooms loops over the rooms and connected floods the
+// board (but only at the end of each row). `solve_checks` and the chain of checks that
+// `run_solve_checks` runs by default both come from this list.
+#define SOLVE_CHECKS(X)                                                                            \
+    X(CHECK_OVERLAP, check_doesnt_overlap(puzzle, solution))                                       \
+    X(CHECK_ROW_COUNT, check_row_count(puzzle, counts, slot))                                      \
+    X(CHECK_COL_COUNT, check_col_count(puzzle, counts, slot))                                      \
+    X(CHECK_DEAD_ENDS, check_dead_ends(puzzle, solution, slot))                                    \
+    X(CHECK_MONSTERS, check_monsters(puzzle, solution, slot))                                      \
+    X(CHECK_WIDE_SPACE, check_wide_space(puzzle, solution, slot))                                  \
+    X(CHECK_TREASURE_ROOMS, treasure_state_check(treasures, solution, slot))                       \
+    X(CHECK_CONNECTED, check_connected(solution, slot))
+
+// The checks the generator runs, the same way. The counts come from the board so they aren't
+// checked. Treasure rooms rejects the most since treasures are tried first, but it's the most
+// expensive so it still goes last.
+#define GENERATE_CHECKS(X)                                                                         \
+    X(CHECK_OVERLAP, check_doesnt_overlap(puzzle, solution))                                       \
+    X(CHECK_INVALID_MONSTER, !is_invalid_monster(puzzle, solution, pos_from_slot(slot)))           \
+    X(CHECK_DEAD_ENDS, check_dead_ends(puzzle, solution, slot))                                    \
+    X(CHECK_MONSTERS, check_monsters(puzzle, solution, slot))                                      \
+    X(CHECK_GENERATED_WIDE_SPACE, check_generated_wide_space(puzzle, solution, slot))              \
+    X(CHECK_TREASURE_ROOMS, check_treasure_rooms(puzzle, solution, slot))                          \
+    X(CHECK_CONNECTED, check_connected(solution, slot))
+
+// For expanding the lists above into a pipeline's order, its length, or a chain of checks.
+#define CHECK_ORDER(check, passes) check,
+#define CHECK_COUNT(check, passes) +1
+#define CHECK_AND(check, passes) STATS_CHECK(stats, check, passes) &&
+
+// The default pipelines.
+static const CheckPipeline solve_checks = {.order = {SOLVE_CHECKS(CHECK_ORDER)},
+                                           .num_checks = 0 SOLVE_CHECKS(CHECK_COUNT)};
+static const CheckPipeline generate_checks = {.order = {GENERATE_CHECKS(CHECK_ORDER)},
+                                              .num_checks = 0 GENERATE_CHECKS(CHECK_COUNT)};
+
+// Rough relative cost of each check, used when tuning.
+static const u8 check_costs[NUM_CHECKS] = {
+    [CHECK_OVERLAP] = 1,
+    [CHECK_ROW_COUNT] = 1,
+    [CHECK_COL_COUNT] = 1,
+    [CHECK_DEAD_ENDS] = 3,
+    [CHECK_MONSTERS] = 3,
+    [CHECK_WIDE_SPACE] = 3,
+    [CHECK_TREASURE_ROOMS] = 12,
+    [CHECK_INVALID_MONSTER] = 2,
+    [CHECK_GENERATED_WIDE_SPACE] = 3,
+    [CHECK_CONNECTED] = 4,
+};
+
+// `treasures` is the solver's TreasureState, or NULL to check every room.
+bool check_passes(Check check, Puzzle puzzle, const WallCounts *counts, TreasureState *treasures,
+                  u64 solution, i32 slot) {
+    switch (check) {
+    case CHECK_OVERLAP:
+        return check_doesnt_overlap(puzzle, solution);
+    case CHECK_ROW_COUNT:
+        return check_row_count(puzzle, counts, slot);
+    case CHECK_COL_COUNT:
+        return check_col_count(puzzle, counts, slot);
+    case CHECK_DEAD_ENDS:
+        return check_dead_ends(puzzle, solution, slot);
+    case CHECK_MONSTERS:
+        return check_monsters(puzzle, solution, slot);
+    case CHECK_WIDE_SPACE:
+        return check_wide_space(puzzle, solution, slot);
+    case CHECK_TREASURE_ROOMS:
+        return treasures ? treasure_state_check(treasures, solution, slot)
+                         : check_treasure_rooms(puzzle, solution, slot);
+    case CHECK_INVALID_MONSTER:
+        return !is_invalid_monster(puzzle, solution, pos_from_slot(slot));
+    case CHECK_GENERATED_WIDE_SPACE:
+        return check_generated_wide_space(puzzle, solution, slot);
+    case CHECK_CONNECTED:
+        return check_connected(solution, slot);
+    case NUM_CHECKS:
+        break;
+    }
+    assert(false);
+    return true;
+}
+
+// Run the checks in the pipeline for the value just placed at `slot`.
+bool run_checks(const CheckPipeline *pipeline, Puzzle puzzle, const WallCounts *counts,
+                TreasureState *treasures, u64 solution, i32 slot, SolveStats *stats) {
+#if defined(DANDD_DEBUG_CHECKS)
+    // Every check that fails counts as a rejection here.
+    bool passed[NUM_CHECKS] = {0};
+    bool all_passed = true;
+    for (i32 i = 0; i < pipeline->num_checks; i++) {
+        Check check = pipeline->order[i];
+        passed[i] = STATS_CHECK(stats, check,
+                                check_passes(check, puzzle, counts, treasures, solution, slot));
+        all_passed = all_passed && passed[i];
+    }
+    return all_passed;
+#else
+    for (i32 i = 0; i < pipeline->num_checks; i++) {
+        Check check = pipeline->order[i];
+        if (!STATS_CHECK(stats, check,
+                         check_passes(check, puzzle, counts, treasures, solution, slot))) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+// How many rejections a check gets for its cost, or -1 if it never ran.
+double check_score(Check check, const SolveStats *stats) {
+    if (!stats->evaluations[check]) {
+        return -1;
+    }
+    double rate = (double)stats->rejections[check] / (double)stats->evaluations[check];
+    return rate / check_costs[check];
+}
+
+// Reorder a pipeline so the checks that reject the most for their cost go first, using stats from
+// a DANDD_STATS build. Checks that never ran keep their order, at the end. Tune a copy of
+// `solve_checks` or `generate_checks`, and only while nothing is searching with it.
+void tune_checks(CheckPipeline *pipeline, const SolveStats *stats) {
+    for (i32 i = 1; i < pipeline->num_checks; i++) {
+        Check check = pipeline->order[i];
+        double score = check_score(check, stats);
+        i32 j = i;
+        while (j > 0 && check_score(pipeline->order[j - 1], stats) < score) {
+            pipeline->order[j] = pipeline->order[j - 1];
+            j--;
+        }
+        pipeline->order[j] = check;
+    }
+}
+
+#if !defined(DANDD_LIBRARY)
+void print_checks(const char *name, const CheckPipeline *pipeline) {
+    printf("%s checks:", name);
+    for (i32 i = 0; i < pipeline->num_checks; i++) {
+        printf(" %s", check_names[pipeline->order[i]]);
+    }
+    printf("\n");
+}
+#endif
+
+// Run the solver's checks, in the order in `checks` or, if it's NULL, the default order. Looping
+// through a pipeline is a lot slower than a chain of checks the compiler can inline, so the
+// default order is run as a chain.
+bool run_solve_checks(const CheckPipeline *checks, Puzzle puzzle, const WallCounts *counts,
+                      TreasureState *treasures, u64 solution, i32 slot, SolveStats *stats) {
+#if !defined(DANDD_DEBUG_CHECKS)
+    if (!checks) {
+        return SOLVE_CHECKS(CHECK_AND) true;
+    }
+#endif
+    return run_checks(checks ? checks : &solve_checks, puzzle, counts, treasures, solution, slot,
+                      stats);
+}
+
+// The same for the generator's checks.
+bool run_generate_checks(const CheckPipeline *checks, Puzzle puzzle, const WallCounts *counts,
+                         u64 solution, i32 slot, SolveStats *stats) {
+#if !defined(DANDD_DEBUG_CHECKS)
+    if (!checks) {
+        return GENERATE_CHECKS(CHECK_AND) true;
+    }
+#endif
+    return run_checks(checks ? checks : &generate_checks, puzzle, counts, NULL, solution, slot,
+                      stats);
+}
+
+// The state of the solver's search over the slots from `first_slot` up to (not including)
+// `end_slot`. The slots before `first_slot` are fixed. Like the generator's GenState, the search
+// can stop at every solution and pick back up from there, so solutions can be streamed out one at
+// a time without a buffer.
+typedef struct {
+    Puzzle puzzle;
+    // The walls placed so far.
+    u64 solution;
+    WallCounts counts;
+    TreasureState treasures;
+    i32 slot;
+    i32 first_slot;
+    i32 end_slot;
+    // Set when the state is stopped at a solution.
+    bool found;
+    // Where to count what the search does in DANDD_STATS builds, can be NULL.
+    SolveStats *stats;
+    // The order to run the checks in, NULL for `solve_checks`.
+    const CheckPipeline *checks;
+} SolveState;
+
+// Start a search over the slots from `first_slot` up to (not including) `end_slot`, with the
+// slots before `first_slot` fixed to their values in `prefix`.
+void solve_init(SolveState *state, Puzzle puzzle, u64 prefix, i32 first_slot, i32 end_slot) {
+    assert(0 <= first_slot);
+    assert(first_slot < end_slot);
+    assert(end_slot <= 64);
+    init_masks();
+    state->puzzle = puzzle;
+    state->solution = prefix;
+    state->counts = (WallCounts){0};
+    for (i32 s = 0; s < first_slot; s++) {
+        if (slot_is_set(prefix, s)) {
+            wall_counts_set(&state->counts, s);
+        }
+    }
+    treasure_state_init(&state->treasures, puzzle, prefix, first_slot);
+    state->slot = first_slot;
+    state->first_slot = first_slot;
+    state->end_slot = end_slot;
+    state->found = false;
+    state->stats = NULL;
+    state->checks = NULL;
+}
+
+// Search for the next solution, which is left in `state->solution` (the slots after `end_slot`
+// are 0). Returns false when there are no more.
+bool solve_next(SolveState *state) {
+    Puzzle puzzle = state->puzzle;
+    u64 solution = state->solution;
+    WallCounts counts = state->counts;
+    i32 slot = state->slot;
+    i32 first_slot = state->first_slot;
+    i32 end_slot = state->end_slot;
+    SolveStats *stats = state->stats;
+    bool found = false;
+
+    if (state->found) {
+        // Backtrack from the last solution so we don't find it again.
+        slot = last_set_slot(solution, slot);
+        STATS_BACKTRACK(stats, end_slot - 1, slot);
+    }
+
+    while (first_slot <= slot && slot < end_slot) {
+        if (!slot_is_set(solution, slot)) {
             solution = slot_set(solution, slot);
-        } break;
-        case WALL: {
-            puzzle_tiles[slot] = EMPTY;
+            wall_counts_set(&counts, slot);
+        } else {
             solution = slot_unset(solution, slot);
-        } break;
-        case EMPTY: {
-            puzzle_tiles[slot] = TREASURE;
-            puzzle.treasures = slot_set(puzzle.treasures, slot);
-        } break;
+            wall_counts_unset(&counts, slot);
+        }
+        STATS_NODE(stats, slot + 1);
+
+        // Check constraints.
+        if (run_solve_checks(state->checks, puzzle, &counts, &state->treasures, solution, slot,
+                             stats)) {
+
+            // Move on to the next slot.
+            if (slot < end_slot - 1) {
+                slot++;
+                continue;
+            }
+
+            // This is a valid solution!
+            // Stop here, the next call backtracks from it and keeps searching for more.
+            found = true;
+            break;
+        }
+
+        // Backtrack to the last set slot (which could be this one).
+        i32 from_slot = slot;
+        slot = last_set_slot(solution, slot);
+        STATS_BACKTRACK(stats, from_slot, slot);
+    }
+
+    state->solution = solution;
+    state->counts = counts;
+    state->slot = slot;
+    state->found = found;
+    return found;
+}
+
+// The solver's search over the slots from `first_slot` up to (not including) `end_slot`. The slots
+// before `first_slot` are fixed to their values in `prefix`. Every partial solution that is valid
+// up to `end_slot` is passed to `on_solution`. Returns the number of solutions found. `checks`
+// and `stats` can be NULL, see SolveState.
+u64 solve_slots(Puzzle puzzle, u64 prefix, i32 first_slot, i32 end_slot, SolutionFn on_solution,
+                void *userdata, const CheckPipeline *checks, SolveStats *stats) {
+    SolveState state;
+    solve_init(&state, puzzle, prefix, first_slot, end_slot);
+    state.checks = checks;
+    state.stats = stats;
+    u64 solution_i = 0;
+    while (solve_next(&state)) {
+        solution_i++;
+        if (!on_solution(userdata, state.solution)) {
+            break;
+        }
+    }
+    return solution_i;
+}
+
+// Call `on_solution` with every solution to the puzzle, in the same order `solve` finds them,
+// until it returns false. Doesn't keep anything around, so it works for puzzles with any number of
+// solutions. Returns the number of solutions passed to `on_solution`.
+u64 solve_each(Puzzle puzzle, SolutionFn on_solution, void *userdata) {
+    return solve_slots(puzzle, 0, 0, 64, on_solution, userdata, NULL, NULL);
+}
+
+// How many solutions to stop after, 0 to never stop.
+u64 solve_mode_limit(SolveMode mode) {
+    switch (mode) {
+    case SOLVE_ALL:
+        return 0;
+    case SOLVE_FIRST:
+        return 1;
+    case SOLVE_UNIQUE:
+        return 2;
+    }
+    return 0;
+}
+
+typedef struct {
+    u64 *solutions;
+    u64 max_solutions;
+    u64 num_solutions;
+    u64 stop_after;
+} SolutionBuffer;
+
+bool record_solution(void *userdata, u64 solution) {
+    SolutionBuffer *buffer = userdata;
+    if (buffer->num_solutions < buffer->max_solutions) {
+        buffer->solutions[buffer->num_solutions] = solution;
+    }
+    buffer->num_solutions++;
+    return !buffer->stop_after || buffer->num_solutions < buffer->stop_after;
+}
+
+// `solve`, running the checks in the order in `checks` (NULL for the default order) and adding
+// what the search did to `stats` (which can be NULL) in DANDD_STATS builds.
+SolveResult solve_with_stats(Puzzle puzzle, u64 *solutions, u64 max_solutions, SolveMode mode,
+                             const CheckPipeline *checks, SolveStats *stats) {
+    SolutionBuffer buffer = {.solutions = solutions,
+                             .max_solutions = max_solutions,
+                             .stop_after = solve_mode_limit(mode)};
+    u64 num_solutions = solve_slots(puzzle, 0, 0, 64, record_solution, &buffer, checks, stats);
+    return (SolveResult){.num_solutions = num_solutions, .hit_max = num_solutions > max_solutions};
+}
+
+// Solve a puzzle
+// Pushes found solutions into the passed in `solutions` pointer which is assumed to be an empty
+// array with length max_solutions. Depending on the mode it finds all the solutions or stops
+// early.
+// The solution space has 2^64 possible solutions, this is a big number that can't fit in a 64-bit
+// int.
+// The search for solutions uses all the constraints as it goes so it doesn't have to check all
+// of these.
+SolveResult solve(Puzzle puzzle, u64 *solutions, u64 max_solutions, SolveMode mode) {
+    return solve_with_stats(puzzle, solutions, max_solutions, mode, NULL, NULL);
+}
+
+// A growable array of u64s.
+typedef struct {
+    u64 *items;
+    u64 len;
+    u64 cap;
+} U64Array;
+
+bool u64_array_push(U64Array *array, u64 item) {
+    if (array->len == array->cap) {
+        u64 cap = array->cap ? array->cap * 2 : 16;
+        u64 *items = realloc(array->items, cap * sizeof(u64));
+        if (!items) {
+            return false;
+        }
+        array->items = items;
+        array->cap = cap;
+    }
+    array->items[array->len++] = item;
+    return true;
+}
+
+void u64_array_free(U64Array *array) {
+    free(array->items);
+    *array = (U64Array){0};
+}
+
+// Threads.
+// A minimal wrapper over pthreads and win32 threads, just enough to run a pool of workers.
+
+typedef void (*ThreadFn)(void *arg);
+
+typedef struct {
+    ThreadFn fn;
+    void *arg;
+} ThreadStart;
+
+#if defined(_WIN32)
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+
+static DWORD WINAPI thread_main(LPVOID arg) {
+    ThreadStart *start = arg;
+    start->fn(start->arg);
+    return 0;
+}
+
+bool thread_start(Thread *thread, ThreadStart *start) {
+    *thread = CreateThread(NULL, 0, thread_main, start, 0, NULL);
+    return *thread != NULL;
+}
+
+void thread_join(Thread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+void mutex_init(Mutex *mutex) {
+    InitializeCriticalSection(mutex);
+}
+
+void mutex_destroy(Mutex *mutex) {
+    DeleteCriticalSection(mutex);
+}
+
+void mutex_lock(Mutex *mutex) {
+    EnterCriticalSection(mutex);
+}
+
+void mutex_unlock(Mutex *mutex) {
+    LeaveCriticalSection(mutex);
+}
+
+void thread_yield(void) {
+    SwitchToThread();
+}
+#else
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+
+static void *thread_main(void *arg) {
+    ThreadStart *start = arg;
+    start->fn(start->arg);
+    return NULL;
+}
+
+bool thread_start(Thread *thread, ThreadStart *start) {
+    return pthread_create(thread, NULL, thread_main, start) == 0;
+}
+
+void thread_join(Thread thread) {
+    pthread_join(thread, NULL);
+}
+
+void mutex_init(Mutex *mutex) {
+    pthread_mutex_init(mutex, NULL);
+}
+
+void mutex_destroy(Mutex *mutex) {
+    pthread_mutex_destroy(mutex);
+}
+
+void mutex_lock(Mutex *mutex) {
+    pthread_mutex_lock(mutex);
+}
+
+void mutex_unlock(Mutex *mutex) {
+    pthread_mutex_unlock(mutex);
+}
+
+void thread_yield(void) {
+    sched_yield();
+}
+#endif
+
+// Atomics.
+// Sequentially consistent operations on u64s, through the compiler builtins so they work in c99.
+
+#if defined(_MSC_VER) && !defined(__clang__)
+u64 atomic_load_u64(u64 *p) {
+    return (u64)_InterlockedOr64((volatile __int64 *)p, 0);
+}
+
+void atomic_store_u64(u64 *p, u64 value) {
+    _InterlockedExchange64((volatile __int64 *)p, (__int64)value);
+}
+
+u64 atomic_fetch_add_u64(u64 *p, u64 value) {
+    return (u64)_InterlockedExchangeAdd64((volatile __int64 *)p, (__int64)value);
+}
+
+// If `*p` is `*expected`, replace it with `desired`. Otherwise load the current value into
+// `*expected`. Returns whether it was replaced.
+bool atomic_compare_exchange_u64(u64 *p, u64 *expected, u64 desired) {
+    __int64 old = _InterlockedCompareExchange64((volatile __int64 *)p, (__int64)desired,
+                                                (__int64)*expected);
+    if ((u64)old == *expected) {
+        return true;
+    }
+    *expected = (u64)old;
+    return false;
+}
+#else
+u64 atomic_load_u64(u64 *p) {
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+void atomic_store_u64(u64 *p, u64 value) {
+    __atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+u64 atomic_fetch_add_u64(u64 *p, u64 value) {
+    return __atomic_fetch_add(p, value, __ATOMIC_SEQ_CST);
+}
+
+// If `*p` is `*expected`, replace it with `desired`. Otherwise load the current value into
+// `*expected`. Returns whether it was replaced.
+bool atomic_compare_exchange_u64(u64 *p, u64 *expected, u64 desired) {
+    return __atomic_compare_exchange_n(p, expected, desired, false, __ATOMIC_SEQ_CST,
+                                       __ATOMIC_SEQ_CST);
+}
+#endif
+
+// Task pool.
+// Runs independent tasks, numbered 0 to num_tasks-1, on a pool of worker threads. Every worker
+// starts with a contiguous block of the tasks in its deque. It takes tasks from the front of its
+// own deque, and when that runs out it steals from the back of the other workers' deques.
+// Tasks don't create new tasks, so once every deque is empty all the work has been handed out.
+
+typedef void (*TaskFn)(void *context, u64 task, i32 worker);
+
+typedef struct {
+    Mutex lock;
+    u64 front;
+    u64 back;
+} TaskDeque;
+
+typedef struct {
+    TaskDeque *deques;
+    i32 num_workers;
+    TaskFn fn;
+    void *context;
+} TaskPool;
+
+typedef struct {
+    TaskPool *pool;
+    i32 id;
+    ThreadStart start;
+} TaskWorker;
+
+bool task_deque_pop_front(TaskDeque *deque, u64 *task) {
+    bool found = false;
+    mutex_lock(&deque->lock);
+    if (deque->front < deque->back) {
+        *task = deque->front++;
+        found = true;
+    }
+    mutex_unlock(&deque->lock);
+    return found;
+}
+
+bool task_deque_pop_back(TaskDeque *deque, u64 *task) {
+    bool found = false;
+    mutex_lock(&deque->lock);
+    if (deque->front < deque->back) {
+        *task = --deque->back;
+        found = true;
+    }
+    mutex_unlock(&deque->lock);
+    return found;
+}
+
+void task_worker_run(void *arg) {
+    TaskWorker *worker = arg;
+    TaskPool *pool = worker->pool;
+    for (;;) {
+        u64 task;
+        bool found = task_deque_pop_front(&pool->deques[worker->id], &task);
+        for (i32 i = 1; !found && i < pool->num_workers; i++) {
+            i32 victim = (worker->id + i) % pool->num_workers;
+            found = task_deque_pop_back(&pool->deques[victim], &task);
+        }
+        if (!found) {
+            return;
+        }
+        pool->fn(pool->context, task, worker->id);
+    }
+}
+
+// Run all the tasks and wait for them to finish. The calling thread is used as worker 0.
+// Returns false without running anything if the pool couldn't be allocated.
+bool run_tasks(u64 num_tasks, i32 num_workers, TaskFn fn, void *context) {
+    assert(num_workers >= 1);
+    TaskDeque *deques = malloc(sizeof(TaskDeque) * (size_t)num_workers);
+    TaskWorker *workers = malloc(sizeof(TaskWorker) * (size_t)num_workers);
+    Thread *threads = malloc(sizeof(Thread) * (size_t)num_workers);
+    if (!deques || !workers || !threads) {
+        free(deques);
+        free(workers);
+        free(threads);
+        return false;
+    }
+
+    TaskPool pool = {.deques = deques, .num_workers = num_workers, .fn = fn, .context = context};
+    for (i32 i = 0; i < num_workers; i++) {
+        mutex_init(&deques[i].lock);
+        deques[i].front = num_tasks * (u64)i / (u64)num_workers;
+        deques[i].back = num_tasks * (u64)(i + 1) / (u64)num_workers;
+        workers[i] = (TaskWorker){.pool = &pool, .id = i};
+        workers[i].start = (ThreadStart){.fn = task_worker_run, .arg = &workers[i]};
+    }
+
+    // If a thread fails to start its tasks just get stolen by the other workers.
+    i32 num_threads = 0;
+    for (i32 i = 1; i < num_workers; i++) {
+        if (thread_start(&threads[num_threads], &workers[i].start)) {
+            num_threads++;
+        }
+    }
+    task_worker_run(&workers[0]);
+    for (i32 i = 0; i < num_threads; i++) {
+        thread_join(threads[i]);
+    }
+
+    for (i32 i = 0; i < num_workers; i++) {
+        mutex_destroy(&deques[i].lock);
+    }
+    free(deques);
+    free(workers);
+    free(threads);
+    return true;
+}
+
+// Parallel solver.
+// Splits the search into independent subproblems by fixing the first rows of the solution. Every
+// valid prefix is a task that searches the rest of the slots. Each task keeps its own solutions
+// and they're merged in prefix order afterwards, which is the same order the serial search finds
+// them in.
+// When the mode stops early a task is skipped if the finished tasks before it already found
+// enough solutions. Tasks only ever stop early on their own count, so the merged result is
+// always the same as the serial one.
+
+typedef struct {
+    // Written with atomics, other tasks read these to see if they can be skipped.
+    u64 num_solutions;
+    u64 finished;
+    U64Array solutions;
+    bool out_of_memory;
+} SolveTaskResult;
+
+typedef struct {
+    Puzzle puzzle;
+    i32 prefix_slots;
+    const u64 *prefixes;
+    SolveTaskResult *results;
+    u64 max_solutions;
+    u64 stop_after;
+} SolveParallel;
+
+typedef struct {
+    SolveTaskResult *result;
+    u64 max_solutions;
+    u64 stop_after;
+    u64 num_solutions;
+} SolveTaskBuffer;
+
+bool record_task_solution(void *userdata, u64 solution) {
+    SolveTaskBuffer *buffer = userdata;
+    SolveTaskResult *result = buffer->result;
+    // No task can contribute more than max_solutions to the merged result.
+    if (result->solutions.len < buffer->max_solutions && !result->out_of_memory) {
+        result->out_of_memory = !u64_array_push(&result->solutions, solution);
+    }
+    buffer->num_solutions++;
+    return !buffer->stop_after || buffer->num_solutions < buffer->stop_after;
+}
+
+void solve_task(void *context, u64 task, i32 worker) {
+    (void)worker;
+    SolveParallel *parallel = context;
+    SolveTaskResult *result = &parallel->results[task];
+    if (parallel->stop_after) {
+        u64 found_before = 0;
+        for (u64 i = 0; i < task && found_before < parallel->stop_after; i++) {
+            if (atomic_load_u64(&parallel->results[i].finished)) {
+                found_before += atomic_load_u64(&parallel->results[i].num_solutions);
+            }
+        }
+        if (found_before >= parallel->stop_after) {
+            atomic_store_u64(&result->finished, 1);
+            return;
+        }
+    }
+    SolveTaskBuffer buffer = {.result = result,
+                              .max_solutions = parallel->max_solutions,
+                              .stop_after = parallel->stop_after};
+    u64 num_solutions =
+        solve_slots(parallel->puzzle, parallel->prefixes[task], parallel->prefix_slots, 64,
+                    record_task_solution, &buffer, NULL, NULL);
+    atomic_store_u64(&result->num_solutions, num_solutions);
+    atomic_store_u64(&result->finished, 1);
+}
+
+bool record_prefix(void *userdata, u64 prefix) {
+    return u64_array_push(userdata, prefix);
+}
+
+// Solve a puzzle using `num_threads` threads. Takes the same arguments and returns the same
+// solutions in the same order as `solve`.
+SolveResult solve_parallel(Puzzle puzzle, u64 *solutions, u64 max_solutions, SolveMode mode,
+                           i32 num_threads) {
+    if (num_threads <= 1) {
+        return solve(puzzle, solutions, max_solutions, mode);
+    }
+    init_masks();
+
+    // Fix more rows until there are enough tasks to keep all the threads busy.
+    i32 prefix_slots = 8;
+    U64Array prefixes = {0};
+    for (;;) {
+        prefixes.len = 0;
+        u64 num_prefixes =
+            solve_slots(puzzle, 0, 0, prefix_slots, record_prefix, &prefixes, NULL, NULL);
+        if (num_prefixes != prefixes.len) {
+            u64_array_free(&prefixes);
+            return solve(puzzle, solutions, max_solutions, mode);
+        }
+        if (num_prefixes >= (u64)num_threads * 8 || prefix_slots >= 32) {
+            break;
+        }
+        prefix_slots += 8;
+    }
+
+    SolveTaskResult *results = calloc(prefixes.len ? prefixes.len : 1, sizeof(SolveTaskResult));
+    SolveParallel context = {.puzzle = puzzle,
+                             .prefix_slots = prefix_slots,
+                             .prefixes = prefixes.items,
+                             .results = results,
+                             .max_solutions = max_solutions,
+                             .stop_after = solve_mode_limit(mode)};
+    if (!results || !run_tasks(prefixes.len, num_threads, solve_task, &context)) {
+        free(results);
+        u64_array_free(&prefixes);
+        return solve(puzzle, solutions, max_solutions, mode);
+    }
+
+    // A task that ran out of memory lost some solutions, and its list may be short of its count
+    // (or never allocated), so none of them are read and it's redone the slow way below.
+    bool out_of_memory = false;
+    for (u64 i = 0; i < prefixes.len; i++) {
+        out_of_memory = out_of_memory || results[i].out_of_memory;
+    }
+    u64 num_solutions = 0;
+    for (u64 i = 0; i < prefixes.len; i++) {
+        SolveTaskResult *result = &results[i];
+        for (u64 j = 0; !out_of_memory && j < result->num_solutions; j++) {
+            if (context.stop_after && num_solutions >= context.stop_after) {
+                break;
+            }
+            // Tasks record up to max_solutions, anything past that is only counted.
+            if (num_solutions < max_solutions) {
+                solutions[num_solutions] = result->solutions.items[j];
+            }
+            num_solutions++;
+        }
+        u64_array_free(&result->solutions);
+    }
+    free(results);
+    u64_array_free(&prefixes);
+
+    if (out_of_memory) {
+        return solve(puzzle, solutions, max_solutions, mode);
+    }
+    return (SolveResult){.num_solutions = num_solutions, .hit_max = num_solutions > max_solutions};
+}
+
+// Batch solver.
+// Solves lots of separate puzzles, split up between the task pool's threads in chunks so that
+// short solves aren't swamped by handing out tasks. With AVX2 each chunk goes through the lane
+// solver below, otherwise each puzzle is a plain `solve`, one after another. The lanes empty out
+// at the end of every chunk, so they get bigger chunks.
+
+#define SOLVE_BATCH_CHUNK 16
+#define SOLVE_LANES_CHUNK 256
+
+typedef struct {
+    const Puzzle *puzzles;
+    u64 num_puzzles;
+    u64 *solutions;
+    u64 max_solutions;
+    SolveMode mode;
+    SolveResult *results;
+} SolveBatch;
+
+// Solve the puzzles of the batch from `first` up to (not including) `end` one at a time.
+void solve_batch_scalar(const SolveBatch *batch, u64 first, u64 end) {
+    for (u64 i = first; i < end; i++) {
+        u64 *solutions = batch->solutions ? &batch->solutions[i * batch->max_solutions] : NULL;
+        batch->results[i] = solve(batch->puzzles[i], solutions, batch->max_solutions, batch->mode);
+    }
+}
+
+// Lane solver.
+// `solve_lanes` runs the searches for SOLVE_LANES puzzles side by side, every lane taking one step
+// (placing one value and checking it) each time round the loop. The checks that are plain
+// bitboard math (overlap, counts, dead ends, monsters and wide spaces) are done for all of the
+// lanes first with no branches, four lanes to an AVX2 vector when the build has AVX2 and one lane
+// at a time when it doesn't. Only the lanes that pass them go on to the treasure rooms and, at the
+// end of a row, the flood fill, which stay scalar. A lane that finishes its puzzle picks up the
+// next one, so the lanes stay full until the puzzles run out. Each lane finds the same solutions in
+// the same order as `solve`. With AVX2 it's a little faster than solving the puzzles one at a time
+// (`dandd bench` has both), the searches soon go off in different directions so most of the work
+// is in the scalar part. Without it it's slower, so `solve_batch` only uses it with AVX2.
+
+#define SOLVE_LANES 8
+
+typedef struct {
+    // Each lane's puzzle (an index into the batch) and search, like a SolveState.
+    u64 puzzle_i[SOLVE_LANES];
+    u64 solution[SOLVE_LANES];
+    u64 occupied[SOLVE_LANES];
+    u64 treasures[SOLVE_LANES];
+    u64 row_wall_counts[SOLVE_LANES];
+    u64 col_wall_counts[SOLVE_LANES];
+    u64 row_walls[SOLVE_LANES];
+    u64 col_walls[SOLVE_LANES];
+    i32 slot[SOLVE_LANES];
+    u64 num_solutions[SOLVE_LANES];
+    TreasureState treasure_states[SOLVE_LANES];
+} SolveLanes;
+
+// Start the search for puzzle `puzzle_i` of the batch in `lane`.
+void solve_lanes_start(SolveLanes *lanes, i32 lane, const SolveBatch *batch, u64 puzzle_i) {
+    Puzzle puzzle = batch->puzzles[puzzle_i];
+    lanes->puzzle_i[lane] = puzzle_i;
+    lanes->solution[lane] = 0;
+    lanes->occupied[lane] = puzzle.monsters | puzzle.treasures;
+    lanes->treasures[lane] = puzzle.treasures;
+    lanes->row_wall_counts[lane] = board_bytes(puzzle.row_wall_counts);
+    lanes->col_wall_counts[lane] = board_bytes(puzzle.col_wall_counts);
+    lanes->row_walls[lane] = 0;
+    lanes->col_walls[lane] = 0;
+    lanes->slot[lane] = 0;
+    lanes->num_solutions[lane] = 0;
+    treasure_state_init(&lanes->treasure_states[lane], puzzle, 0, 0);
+}
+
+// Move the search in lane `from` to lane `to`.
+void solve_lanes_move(SolveLanes *lanes, i32 to, i32 from) {
+    lanes->puzzle_i[to] = lanes->puzzle_i[from];
+    lanes->solution[to] = lanes->solution[from];
+    lanes->occupied[to] = lanes->occupied[from];
+    lanes->treasures[to] = lanes->treasures[from];
+    lanes->row_wall_counts[to] = lanes->row_wall_counts[from];
+    lanes->col_wall_counts[to] = lanes->col_wall_counts[from];
+    lanes->row_walls[to] = lanes->row_walls[from];
+    lanes->col_walls[to] = lanes->col_walls[from];
+    lanes->slot[to] = lanes->slot[from];
+    lanes->num_solutions[to] = lanes->num_solutions[from];
+    lanes->treasure_states[to] = lanes->treasure_states[from];
+}
+
+#if defined(__AVX2__)
+// The first loop of `solve_lanes` for lanes `lane` to `lane + 3`, in AVX2 with a lane in each
+// 64 bit element. The masks that the scalar loop looks up by slot are built from the slot's bit
+// instead, since looking them up would need a gather for each one.
+void solve_lanes_step4(SolveLanes *lanes, i32 lane, bool *passed) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i ones = _mm256_set1_epi64x(-1);
+    __m256i col_0 = _mm256_set1_epi64x((i64)BOARD_COL_0);
+    __m256i col_7 = _mm256_set1_epi64x((i64)BOARD_COL_7);
+    __m256i byte = _mm256_set1_epi64x(0xff);
+
+    __m256i slot = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)&lanes->slot[lane]));
+    __m256i row = _mm256_srli_epi64(slot, 3);
+    __m256i col = _mm256_and_si256(slot, _mm256_set1_epi64x(7));
+    __m256i row_shift = _mm256_sub_epi64(_mm256_set1_epi64x(56), _mm256_slli_epi64(row, 3));
+    __m256i col_shift = _mm256_sub_epi64(_mm256_set1_epi64x(56), _mm256_slli_epi64(col, 3));
+    __m256i bit = _mm256_sllv_epi64(_mm256_set1_epi64x(1),
+                                    _mm256_sub_epi64(_mm256_set1_epi64x(63), slot));
+
+    // Toggle the slot and add the wall to the counts, or take it off. `(n ^ wall) - wall` is -n
+    // when placing a wall (`wall` all 1s) and n when taking one out, and it's subtracted.
+    __m256i solution = _mm256_loadu_si256((const __m256i *)&lanes->solution[lane]);
+    __m256i wall = _mm256_cmpeq_epi64(_mm256_and_si256(solution, bit), zero);
+    solution = _mm256_xor_si256(solution, bit);
+    __m256i row_add = _mm256_sllv_epi64(_mm256_set1_epi64x(1), row_shift);
+    __m256i col_add = _mm256_sllv_epi64(_mm256_set1_epi64x(1), col_shift);
+    __m256i row_walls = _mm256_sub_epi64(
+        _mm256_loadu_si256((const __m256i *)&lanes->row_walls[lane]),
+        _mm256_sub_epi64(_mm256_xor_si256(row_add, wall), wall));
+    __m256i col_walls = _mm256_sub_epi64(
+        _mm256_loadu_si256((const __m256i *)&lanes->col_walls[lane]),
+        _mm256_sub_epi64(_mm256_xor_si256(col_add, wall), wall));
+    _mm256_storeu_si256((__m256i *)&lanes->solution[lane], solution);
+    _mm256_storeu_si256((__m256i *)&lanes->row_walls[lane], row_walls);
+    _mm256_storeu_si256((__m256i *)&lanes->col_walls[lane], col_walls);
+
+    __m256i in_row = _mm256_and_si256(_mm256_srlv_epi64(row_walls, row_shift), byte);
+    __m256i in_col = _mm256_and_si256(_mm256_srlv_epi64(col_walls, col_shift), byte);
+    __m256i row_count = _mm256_and_si256(
+        _mm256_srlv_epi64(_mm256_loadu_si256((const __m256i *)&lanes->row_wall_counts[lane]),
+                          row_shift),
+        byte);
+    __m256i col_count = _mm256_and_si256(
+        _mm256_srlv_epi64(_mm256_loadu_si256((const __m256i *)&lanes->col_wall_counts[lane]),
+                          col_shift),
+        byte);
+    __m256i row_left = _mm256_sub_epi64(_mm256_add_epi64(in_row, _mm256_set1_epi64x(7)), col);
+    __m256i col_left = _mm256_sub_epi64(_mm256_add_epi64(in_col, _mm256_set1_epi64x(7)), row);
+    __m256i failed = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpgt_epi64(in_row, row_count),
+                        _mm256_cmpgt_epi64(row_count, row_left)),
+        _mm256_or_si256(_mm256_cmpgt_epi64(in_col, col_count),
+                        _mm256_cmpgt_epi64(col_count, col_left)));
+
+    __m256i occupied = _mm256_loadu_si256((const __m256i *)&lanes->occupied[lane]);
+    __m256i treasures = _mm256_loadu_si256((const __m256i *)&lanes->treasures[lane]);
+    __m256i open = _mm256_xor_si256(solution, ones);
+    __m256i above = _mm256_srli_epi64(open, 8);
+    __m256i below = _mm256_slli_epi64(open, 8);
+    __m256i left = _mm256_andnot_si256(col_0, _mm256_srli_epi64(open, 1));
+    __m256i right = _mm256_andnot_si256(col_7, _mm256_slli_epi64(open, 1));
+    __m256i sum0 = _mm256_xor_si256(above, below);
+    __m256i sum1 = _mm256_xor_si256(left, right);
+    __m256i carries =
+        _mm256_or_si256(_mm256_and_si256(above, below), _mm256_and_si256(left, right));
+    __m256i dead_ends =
+        _mm256_andnot_si256(_mm256_or_si256(carries, _mm256_and_si256(sum0, sum1)),
+                            _mm256_andnot_si256(occupied, open));
+    __m256i occupied_neighbors = _mm256_or_si256(
+        _mm256_or_si256(_mm256_srli_epi64(occupied, 8), _mm256_slli_epi64(occupied, 8)),
+        _mm256_or_si256(_mm256_andnot_si256(col_0, _mm256_srli_epi64(occupied, 1)),
+                        _mm256_andnot_si256(col_7, _mm256_slli_epi64(occupied, 1))));
+    __m256i invalid_monsters = _mm256_and_si256(
+        _mm256_andnot_si256(treasures, occupied),
+        _mm256_or_si256(occupied_neighbors,
+                        _mm256_andnot_si256(_mm256_andnot_si256(carries,
+                                                                _mm256_xor_si256(sum0, sum1)),
+                                            ones)));
+
+    // masks.dead_end_checks and masks.monster_checks: the slot and the cells above and to the
+    // left of it, and for monsters only the cell above, except on the bottom row.
+    __m256i bit_above = _mm256_slli_epi64(bit, 8);
+    __m256i bit_left = _mm256_andnot_si256(col_7, _mm256_slli_epi64(bit, 1));
+    __m256i dead_end_checks = _mm256_or_si256(_mm256_or_si256(bit, bit_above), bit_left);
+    __m256i monster_checks = _mm256_or_si256(
+        _mm256_or_si256(bit_above,
+                        _mm256_and_si256(bit_left, _mm256_set1_epi64x((i64)BOARD_ROW_7))),
+        _mm256_and_si256(bit, _mm256_set1_epi64x(1)));
+
+    // masks.wide_space and masks.wide_space_neighbors: the 2x2 square with the slot in its
+    // bottom right corner, if there's room for it, and the rest of the 4x4 square around that.
+    __m256i corner = _mm256_andnot_si256(_mm256_set1_epi64x((i64)(BOARD_ROW_0 | BOARD_COL_0)), bit);
+    __m256i space = _mm256_or_si256(corner, _mm256_slli_epi64(corner, 1));
+    space = _mm256_or_si256(space, _mm256_slli_epi64(space, 8));
+    __m256i span = _mm256_or_si256(
+        _mm256_or_si256(corner, _mm256_slli_epi64(corner, 1)),
+        _mm256_or_si256(_mm256_andnot_si256(col_7, _mm256_slli_epi64(corner, 2)),
+                        _mm256_andnot_si256(col_0, _mm256_srli_epi64(corner, 1))));
+    span = _mm256_or_si256(
+        _mm256_or_si256(span, _mm256_slli_epi64(span, 8)),
+        _mm256_or_si256(_mm256_slli_epi64(span, 16), _mm256_srli_epi64(span, 8)));
+    __m256i space_neighbors = _mm256_andnot_si256(space, span);
+    __m256i closed = _mm256_and_si256(space, _mm256_or_si256(solution, occupied));
+    __m256i open_space = _mm256_andnot_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi64(space, zero),
+                        _mm256_or_si256(_mm256_xor_si256(_mm256_cmpeq_epi64(closed, zero), ones),
+                                        _mm256_xor_si256(_mm256_cmpeq_epi64(
+                                                             _mm256_and_si256(space_neighbors,
+                                                                              treasures),
+                                                             zero),
+                                                         ones))),
+        ones);
+
+    __m256i bad = _mm256_or_si256(
+        _mm256_or_si256(_mm256_and_si256(solution, occupied),
+                        _mm256_and_si256(dead_ends, dead_end_checks)),
+        _mm256_and_si256(invalid_monsters, monster_checks));
+    failed = _mm256_or_si256(_mm256_or_si256(failed, open_space),
+                             _mm256_xor_si256(_mm256_cmpeq_epi64(bad, zero), ones));
+    i32 failed_lanes = _mm256_movemask_pd(_mm256_castsi256_pd(failed));
+    for (i32 i = 0; i < 4; i++) {
+        passed[i] = !(failed_lanes >> i & 1);
+    }
+}
+#endif
+
+// Solve the puzzles of the batch from `first` up to (not including) `end` in lanes.
+void solve_lanes(const SolveBatch *batch, u64 first, u64 end) {
+    // The lanes with a puzzle are always the first `num_active`. The rest are zeroed, since the
+    // vector checks run on them too.
+    SolveLanes lanes = {0};
+    u64 stop_after = solve_mode_limit(batch->mode);
+    u64 next = first;
+    i32 num_active = 0;
+    for (i32 lane = 0; lane < SOLVE_LANES && next < end; lane++) {
+        solve_lanes_start(&lanes, lane, batch, next++);
+        num_active++;
+    }
+
+    bool passed[SOLVE_LANES];
+    while (num_active > 0) {
+        // Place the next value in every lane: a wall if the slot is open, otherwise take the wall
+        // back out and leave it open. Then run the bitboard checks on all of them.
+#if defined(__AVX2__)
+        for (i32 lane = 0; lane < num_active; lane += 4) {
+            solve_lanes_step4(&lanes, lane, &passed[lane]);
+        }
+#else
+        for (i32 lane = 0; lane < num_active; lane++) {
+            i32 slot = lanes.slot[lane];
+            i32 row = slot / 8;
+            i32 col = slot % 8;
+            i32 row_shift = 56 - 8 * row;
+            i32 col_shift = 56 - 8 * col;
+            u64 bit = (u64)1 << (63 - slot);
+            bool wall = !(lanes.solution[lane] & bit);
+            u64 solution = lanes.solution[lane] ^ bit;
+            u64 row_walls = wall ? lanes.row_walls[lane] + ((u64)1 << row_shift)
+                                 : lanes.row_walls[lane] - ((u64)1 << row_shift);
+            u64 col_walls = wall ? lanes.col_walls[lane] + ((u64)1 << col_shift)
+                                 : lanes.col_walls[lane] - ((u64)1 << col_shift);
+            lanes.solution[lane] = solution;
+            lanes.row_walls[lane] = row_walls;
+            lanes.col_walls[lane] = col_walls;
+
+            // The same checks as the start of `run_solve_checks`, with the dead end and monster
+            // kernels done together since they both count the open neighbors.
+            u64 occupied = lanes.occupied[lane];
+            u64 treasures = lanes.treasures[lane];
+            i32 in_row = (i32)(row_walls >> row_shift & 0xff);
+            i32 in_col = (i32)(col_walls >> col_shift & 0xff);
+            i32 row_count = (i32)(lanes.row_wall_counts[lane] >> row_shift & 0xff);
+            i32 col_count = (i32)(lanes.col_wall_counts[lane] >> col_shift & 0xff);
+            u64 open = ~solution;
+            u64 above = board_from_above(open);
+            u64 below = board_from_below(open);
+            u64 left = board_from_left(open);
+            u64 right = board_from_right(open);
+            u64 sum0 = above ^ below;
+            u64 sum1 = left ^ right;
+            u64 carries = (above & below) | (left & right);
+            u64 dead_ends = open & ~occupied & ~(carries | (sum0 & sum1));
+            u64 invalid_monsters = occupied & ~treasures &
+                                   (board_neighbors(occupied) | ~((sum0 ^ sum1) & ~carries));
+            u64 space = masks.wide_space[slot];
+            u64 open_space = space & ~((space & (solution | occupied)) ? ~(u64)0 : 0) &
+                             ~((masks.wide_space_neighbors[slot] & treasures) ? ~(u64)0 : 0);
+            passed[lane] = !(solution & occupied) & (in_row <= row_count) &
+                           (in_row + 7 - col >= row_count) & (in_col <= col_count) &
+                           (in_col + 7 - row >= col_count) &
+                           !(dead_ends & masks.dead_end_checks[slot]) &
+                           !(invalid_monsters & masks.monster_checks[slot]) & !open_space;
+        }
+#endif
+
+        // Backwards, so a finished lane can be filled from the last lane, which has already taken
+        // its step.
+        for (i32 lane = num_active - 1; lane >= 0; lane--) {
+            u64 solution = lanes.solution[lane];
+            i32 slot = lanes.slot[lane];
+            if (passed[lane] &&
+                (!lanes.treasures[lane] ||
+                 treasure_state_check(&lanes.treasure_states[lane], solution, slot)) &&
+                (slot % 8 != 7 || check_connected(solution, slot))) {
+                if (slot < 63) {
+                    lanes.slot[lane] = slot + 1;
+                    continue;
+                }
+                u64 puzzle_i = lanes.puzzle_i[lane];
+                u64 solution_i = lanes.num_solutions[lane]++;
+                if (solution_i < batch->max_solutions) {
+                    batch->solutions[puzzle_i * batch->max_solutions + solution_i] = solution;
+                }
+            }
+            // Backtrack to the last wall, which could be this one, as `solve_next` does.
+            slot = last_set_slot(solution, slot);
+            bool stopped = stop_after && lanes.num_solutions[lane] >= stop_after;
+            if (slot >= 0 && !stopped) {
+                lanes.slot[lane] = slot;
+                continue;
+            }
+
+            // This lane's puzzle is done, start the next one.
+            u64 num_solutions = lanes.num_solutions[lane];
+            batch->results[lanes.puzzle_i[lane]] = (SolveResult){
+                .num_solutions = num_solutions, .hit_max = num_solutions > batch->max_solutions};
+            if (next < end) {
+                solve_lanes_start(&lanes, lane, batch, next++);
+            } else {
+                solve_lanes_move(&lanes, lane, --num_active);
+            }
+        }
+    }
+}
+
+#if defined(__AVX2__)
+#define SOLVE_BATCH_TASK_SIZE SOLVE_LANES_CHUNK
+#else
+#define SOLVE_BATCH_TASK_SIZE SOLVE_BATCH_CHUNK
+#endif
+
+// Solve the puzzles of the batch from `first` up to (not including) `end` whichever way is fastest
+// in this build.
+void solve_batch_range(const SolveBatch *batch, u64 first, u64 end) {
+#if defined(__AVX2__)
+    solve_lanes(batch, first, end);
+#else
+    solve_batch_scalar(batch, first, end);
+#endif
+}
+
+void solve_batch_task(void *context, u64 task, i32 worker) {
+    (void)worker;
+    SolveBatch *batch = context;
+    u64 first = task * SOLVE_BATCH_TASK_SIZE;
+    u64 end = first + SOLVE_BATCH_TASK_SIZE;
+    solve_batch_range(batch, first, end < batch->num_puzzles ? end : batch->num_puzzles);
+}
+
+// Solve `num_puzzles` puzzles using `num_threads` threads. The solutions for puzzle i go in
+// `solutions[i * max_solutions]` onwards (it can be NULL if max_solutions is 0) and its result in
+// `results[i]`, the same as calling `solve` on each one.
+void solve_batch(const Puzzle *puzzles, u64 num_puzzles, u64 *solutions, u64 max_solutions,
+                 SolveMode mode, SolveResult *results, i32 num_threads) {
+    init_masks();
+    SolveBatch batch = {.puzzles = puzzles,
+                        .num_puzzles = num_puzzles,
+                        .solutions = solutions,
+                        .max_solutions = max_solutions,
+                        .mode = mode,
+                        .results = results};
+    u64 num_tasks = (num_puzzles + SOLVE_BATCH_TASK_SIZE - 1) / SOLVE_BATCH_TASK_SIZE;
+    if (num_threads <= 1 || num_tasks <= 1 ||
+        !run_tasks(num_tasks, num_threads, solve_batch_task, &batch)) {
+        solve_batch_range(&batch, 0, num_puzzles);
+    }
+}
+
+// Solution cache.
+// A fixed size table of solve results keyed by the whole puzzle, which `solve_cached` checks
+// before solving. Entries are open addressed, a puzzle can be in any of the SOLVE_CACHE_PROBES
+// entries after its hash, and when they're all taken a clock hand picks one that hasn't been used
+// since the hand last passed it. The cache can be shared between threads without locks. Every
+// entry has a sequence number that's odd while a thread is writing it, a reader that sees it change
+// treats the entry as a miss, and a writer that finds another writer there just skips the insert.
+
+#define SOLVE_CACHE_PROBES 8
+#define SOLVE_CACHE_SOLUTIONS 2
+// How `SolveCacheEntry.result` is packed.
+#define SOLVE_CACHE_COMPLETE ((u64)1 << 63)
+#define SOLVE_CACHE_STORED_SHIFT 61
+#define SOLVE_CACHE_COUNT_MASK (((u64)1 << SOLVE_CACHE_STORED_SHIFT) - 1)
+
+// A row or column has at most 8 walls. Puzzles with bigger counts have no solutions, and they'd
+// alias smaller counts in `pack_counts`, so anything keyed by packed counts has to check first.
+bool counts_are_valid(Puzzle puzzle) {
+    for (i32 i = 0; i < 8; i++) {
+        if (puzzle.row_wall_counts[i] > 8 || puzzle.col_wall_counts[i] > 8) {
+            return false;
+        }
+    }
+    return true;
+}
+
+u64 pack_counts(Puzzle puzzle) {
+    assert(counts_are_valid(puzzle));
+    u64 counts = 0;
+    for (i32 i = 0; i < 8; i++) {
+        counts |= (u64)(puzzle.row_wall_counts[i] & 0xF) << (4 * i);
+        counts |= (u64)(puzzle.col_wall_counts[i] & 0xF) << (32 + 4 * i);
+    }
+    return counts;
+}
+
+u64 mix_u64(u64 x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111eb;
+    x ^= x >> 31;
+    return x;
+}
+
+// Mix the parts of a puzzle into a hash (the splitmix64 finalizer on each part).
+u64 puzzle_hash(Puzzle puzzle) {
+    u64 hash = mix_u64(pack_counts(puzzle));
+    hash = mix_u64(hash ^ puzzle.monsters);
+    return mix_u64(hash ^ puzzle.treasures);
+}
+
+typedef struct {
+    // Odd while the entry is being written, 0 if it never has been.
+    u64 sequence;
+    // The puzzle, the counts packed with `pack_counts`.
+    u64 counts;
+    u64 monsters;
+    u64 treasures;
+    // The number of solutions found, how many of them are in `solutions` and whether the search
+    // found all of them rather than stopping early.
+    u64 result;
+    u64 solutions[SOLVE_CACHE_SOLUTIONS];
+    // Set when the entry is used, cleared when the clock hand passes it.
+    u64 referenced;
+} SolveCacheEntry;
+
+typedef struct {
+    SolveCacheEntry *entries;
+    u64 mask;
+    u64 hand;
+    u64 hits;
+    u64 misses;
+} SolveCache;
+
+// Makes a cache with room for at least `capacity` puzzles. Returns false if out of memory.
+bool solve_cache_init(SolveCache *cache, u64 capacity) {
+    u64 num_entries = SOLVE_CACHE_PROBES;
+    while (num_entries < capacity) {
+        num_entries *= 2;
+    }
+    *cache = (SolveCache){.entries = calloc(num_entries, sizeof(SolveCacheEntry)),
+                          .mask = num_entries - 1};
+    return cache->entries != NULL;
+}
+
+void solve_cache_free(SolveCache *cache) {
+    free(cache->entries);
+    *cache = (SolveCache){0};
+}
+
+// Copies an entry out, returns false if it's empty or was written while it was being copied.
+bool solve_cache_read(SolveCacheEntry *entry, SolveCacheEntry *copy) {
+    u64 sequence = atomic_load_u64(&entry->sequence);
+    if (!sequence || (sequence & 1)) {
+        return false;
+    }
+    copy->counts = atomic_load_u64(&entry->counts);
+    copy->monsters = atomic_load_u64(&entry->monsters);
+    copy->treasures = atomic_load_u64(&entry->treasures);
+    copy->result = atomic_load_u64(&entry->result);
+    for (i32 i = 0; i < SOLVE_CACHE_SOLUTIONS; i++) {
+        copy->solutions[i] = atomic_load_u64(&entry->solutions[i]);
+    }
+    return atomic_load_u64(&entry->sequence) == sequence;
+}
+
+bool solve_cache_entry_is(const SolveCacheEntry *entry, Puzzle puzzle, u64 counts) {
+    return entry->counts == counts && entry->monsters == puzzle.monsters &&
+           entry->treasures == puzzle.treasures;
+}
+
+// Looks for a result that answers this solve. A search that stopped early only answers modes
+// that stop at the same point or sooner, and it only has the first SOLVE_CACHE_SOLUTIONS
+// solutions. Returns false on a miss.
+bool solve_cache_lookup(SolveCache *cache, Puzzle puzzle, u64 *solutions, u64 max_solutions,
+                        SolveMode mode, SolveResult *result) {
+    u64 counts = pack_counts(puzzle);
+    u64 hash = puzzle_hash(puzzle);
+    u64 limit = solve_mode_limit(mode);
+    for (u64 i = 0; i < SOLVE_CACHE_PROBES; i++) {
+        SolveCacheEntry *entry = &cache->entries[(hash + i) & cache->mask];
+        SolveCacheEntry copy;
+        if (!solve_cache_read(entry, &copy) || !solve_cache_entry_is(&copy, puzzle, counts)) {
+            continue;
+        }
+        u64 count = copy.result & SOLVE_CACHE_COUNT_MASK;
+        u64 stored = (copy.result >> SOLVE_CACHE_STORED_SHIFT) & 3;
+        if (!(copy.result & SOLVE_CACHE_COMPLETE) && !(limit && count >= limit)) {
+            break;
+        }
+        u64 num_solutions = limit && count > limit ? limit : count;
+        u64 num_wanted = num_solutions < max_solutions ? num_solutions : max_solutions;
+        if (num_wanted > stored) {
+            break;
+        }
+        for (u64 j = 0; j < num_wanted; j++) {
+            solutions[j] = copy.solutions[j];
+        }
+        atomic_store_u64(&entry->referenced, 1);
+        atomic_fetch_add_u64(&cache->hits, 1);
+        *result = (SolveResult){.num_solutions = num_solutions,
+                                .hit_max = num_solutions > max_solutions};
+        return true;
+    }
+    atomic_fetch_add_u64(&cache->misses, 1);
+    return false;
+}
+
+// Adds the result of a solve, replacing the puzzle's old entry, an empty entry or whichever one
+// the clock hand stops at.
+void solve_cache_insert(SolveCache *cache, Puzzle puzzle, const u64 *solutions, u64 max_solutions,
+                        SolveMode mode, SolveResult result) {
+    u64 counts = pack_counts(puzzle);
+    u64 hash = puzzle_hash(puzzle);
+    u64 limit = solve_mode_limit(mode);
+    SolveCacheEntry *victim = NULL;
+    for (u64 i = 0; i < SOLVE_CACHE_PROBES && !victim; i++) {
+        SolveCacheEntry *entry = &cache->entries[(hash + i) & cache->mask];
+        SolveCacheEntry copy;
+        if (!atomic_load_u64(&entry->sequence) ||
+            (solve_cache_read(entry, &copy) && solve_cache_entry_is(&copy, puzzle, counts))) {
+            victim = entry;
+        }
+    }
+    if (!victim) {
+        // Give every entry a second chance, clearing them as the hand goes past. If they were all
+        // used since the last time around, take the one the hand started at.
+        u64 hand = atomic_fetch_add_u64(&cache->hand, 1);
+        victim = &cache->entries[(hash + hand % SOLVE_CACHE_PROBES) & cache->mask];
+        for (u64 i = 0; i < SOLVE_CACHE_PROBES; i++) {
+            SolveCacheEntry *entry =
+                &cache->entries[(hash + (hand + i) % SOLVE_CACHE_PROBES) & cache->mask];
+            if (!atomic_load_u64(&entry->referenced)) {
+                victim = entry;
+                break;
+            }
+            atomic_store_u64(&entry->referenced, 0);
+        }
+    }
+
+    u64 sequence = atomic_load_u64(&victim->sequence);
+    if ((sequence & 1) ||
+        !atomic_compare_exchange_u64(&victim->sequence, &sequence, sequence + 1)) {
+        return;
+    }
+    u64 stored = result.num_solutions < max_solutions ? result.num_solutions : max_solutions;
+    stored = stored < SOLVE_CACHE_SOLUTIONS ? stored : SOLVE_CACHE_SOLUTIONS;
+    bool complete = !limit || result.num_solutions < limit;
+    atomic_store_u64(&victim->counts, counts);
+    atomic_store_u64(&victim->monsters, puzzle.monsters);
+    atomic_store_u64(&victim->treasures, puzzle.treasures);
+    atomic_store_u64(&victim->result, (complete ? SOLVE_CACHE_COMPLETE : 0) |
+                                          stored << SOLVE_CACHE_STORED_SHIFT |
+                                          (result.num_solutions & SOLVE_CACHE_COUNT_MASK));
+    for (u64 i = 0; i < stored; i++) {
+        atomic_store_u64(&victim->solutions[i], solutions[i]);
+    }
+    atomic_store_u64(&victim->referenced, 1);
+    atomic_store_u64(&victim->sequence, sequence + 2);
+}
+
+// `solve`, but checks the cache first and adds what it solves to it.
+SolveResult solve_cached(SolveCache *cache, Puzzle puzzle, u64 *solutions, u64 max_solutions,
+                         SolveMode mode) {
+    SolveResult result = {0};
+    // `solve` would find no solutions too, but the counts can't be cached.
+    if (!counts_are_valid(puzzle)) {
+        return result;
+    }
+    if (solve_cache_lookup(cache, puzzle, solutions, max_solutions, mode, &result)) {
+        return result;
+    }
+    result = solve(puzzle, solutions, max_solutions, mode);
+    solve_cache_insert(cache, puzzle, solutions, max_solutions, mode, result);
+    return result;
+}
+
+// Row at a time solver.
+// Instead of branching on one slot at a time, this picks a whole row of walls at once out of the
+// row patterns with the right number of walls. Rows are bytes with column 0 in the high bit, the
+// same as in the full solution, and the constraints are checked for the whole row at once with
+// shifts and masks.
+
+u8 board_row(u64 board, i32 row) {
+    return (u8)(board >> (56 - 8 * row));
+}
+
+u64 row_board(u8 bits, i32 row) {
+    return (u64)bits << (56 - 8 * row);
+}
+
+// Cells in `open` with at least 2 open neighbors. `above` and `below` are the open cells of the
+// rows above and below, or 0 if there's no row there.
+u8 row_two_open_neighbors(u8 above, u8 open, u8 below) {
+    u8 left = open >> 1;
+    u8 right = (u8)(open << 1);
+    // Add up the 4 neighbors bitwise, 2 half adders and then check for any carries.
+    u8 sum0 = above ^ below;
+    u8 carry0 = above & below;
+    u8 sum1 = left ^ right;
+    u8 carry1 = left & right;
+    return carry0 | carry1 | (sum0 & sum1);
+}
+
+// Cells in `open` with exactly 1 open neighbor.
+u8 row_one_open_neighbor(u8 above, u8 open, u8 below) {
+    u8 left = open >> 1;
+    u8 right = (u8)(open << 1);
+    u8 sum0 = above ^ below;
+    u8 carry0 = above & below;
+    u8 sum1 = left ^ right;
+    u8 carry1 = left & right;
+    return (sum0 ^ sum1) & (u8)~(carry0 | carry1);
+}
+
+// The number of walls still needed in each column, bit sliced. Bit c of `bits[i]` is bit i of the
+// count for the column in bit c, so whole rows can be subtracted and compared at once.
+typedef struct {
+    u8 bits[4];
+} ColCounts;
+
+ColCounts col_counts(Puzzle puzzle) {
+    ColCounts counts = {{0}};
+    for (i32 col = 0; col < 8; col++) {
+        for (i32 i = 0; i < 4; i++) {
+            if (puzzle.col_wall_counts[col] & (1 << i)) {
+                counts.bits[i] |= (u8)(0x80 >> col);
+            }
+        }
+    }
+    return counts;
+}
+
+// The columns that still need exactly `value` walls.
+u8 col_counts_equal(ColCounts counts, i32 value) {
+    u8 equal = 0xFF;
+    for (i32 i = 0; i < 4; i++) {
+        equal &= (value & (1 << i)) ? counts.bits[i] : (u8)~counts.bits[i];
+    }
+    return equal;
+}
+
+// Take one wall off the columns in `row`. They must all still need a wall.
+ColCounts col_counts_subtract(ColCounts counts, u8 row) {
+    u8 borrow = row;
+    for (i32 i = 0; i < 4; i++) {
+        u8 bits = counts.bits[i];
+        counts.bits[i] = bits ^ borrow;
+        borrow &= (u8)~bits;
+    }
+    return counts;
+}
+
+// The parts of a puzzle the row solver uses, split up into rows.
+typedef struct {
+    Puzzle puzzle;
+    u8 monsters[8];
+    // Monsters and treasures.
+    u8 occupied[8];
+    // Wide spaces (by their bottom right corner) that are next to a treasure, so they're allowed.
+    u8 allowed_wide_spaces[8];
+} RowPuzzle;
+
+RowPuzzle row_puzzle(Puzzle puzzle) {
+    RowPuzzle rows = {.puzzle = puzzle};
+    u64 allowed_wide_spaces = 0;
+    for (i32 slot = 0; slot < 64; slot++) {
+        if (masks.wide_space_neighbors[slot] & puzzle.treasures) {
+            allowed_wide_spaces = slot_set(allowed_wide_spaces, slot);
+        }
+    }
+    for (i32 row = 0; row < 8; row++) {
+        rows.monsters[row] = board_row(puzzle.monsters, row);
+        rows.occupied[row] = board_row(puzzle.monsters | puzzle.treasures, row);
+        rows.allowed_wide_spaces[row] = board_row(allowed_wide_spaces, row);
+    }
+    return rows;
+}
+
+// Checks that don't depend on the walls at all. If these fail the puzzle has no solutions.
+bool check_row_puzzle(const RowPuzzle *rows) {
+    Puzzle puzzle = rows->puzzle;
+    i32 row_walls = 0;
+    i32 col_walls = 0;
+    for (i32 i = 0; i < 8; i++) {
+        if (puzzle.row_wall_counts[i] > 8 || puzzle.col_wall_counts[i] > 8) {
+            return false;
+        }
+        row_walls += puzzle.row_wall_counts[i];
+        col_walls += puzzle.col_wall_counts[i];
+    }
+    if (row_walls != col_walls) {
+        return false;
+    }
+    // Monsters can't border monsters or treasures.
+    for (i32 slot = 0; slot < 64; slot++) {
+        if (slot_is_set(puzzle.monsters, slot) &&
+            masks.border[slot] & (puzzle.monsters | puzzle.treasures)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Check the constraints that placing `row` (the last row in `solution`) could break. Like the
+// slot by slot checks, the rows after it are treated as open.
+bool check_row(const RowPuzzle *rows, TreasureState *treasures, u64 solution, i32 row) {
+    u8 open = (u8)~board_row(solution, row);
+    u8 empty = open & (u8)~rows->occupied[row];
+    u8 above = row > 0 ? (u8)~board_row(solution, row - 1) : 0;
+
+    if (row > 0) {
+        // Wide spaces between this row and the one above.
+        u8 empty_above = above & (u8)~rows->occupied[row - 1];
+        u8 both = empty & empty_above;
+        u8 wide_spaces = both & (both >> 1);
+        if (wide_spaces & (u8)~rows->allowed_wide_spaces[row]) {
+            return false;
+        }
+
+        // The row above is finished now, so check its dead ends and monsters.
+        u8 above_above = row > 1 ? (u8)~board_row(solution, row - 2) : 0;
+        if (empty_above & (u8)~row_two_open_neighbors(above_above, above, open)) {
+            return false;
+        }
+        if (rows->monsters[row - 1] & (u8)~row_one_open_neighbor(above_above, above, open)) {
+            return false;
+        }
+    }
+
+    // The row below isn't placed yet, so it counts as open unless this is the last row.
+    if (row < 7) {
+        if (empty & (u8)~row_two_open_neighbors(above, open, 0xFF)) {
+            return false;
+        }
+        // A monster that already has 2 ways out can't be fixed by the row below.
+        if (rows->monsters[row] & row_two_open_neighbors(above, open, 0)) {
+            return false;
+        }
+    } else {
+        if (empty & (u8)~row_two_open_neighbors(above, open, 0)) {
+            return false;
+        }
+        if (rows->monsters[row] & (u8)~row_one_open_neighbor(above, open, 0)) {
+            return false;
+        }
+    }
+
+    return treasure_state_check_slots(treasures, solution, row * 8, row * 8 + 8) &&
+           check_connected(solution, row * 8 + 7);
+}
+
+// Row states.
+// Lots of different rows above can leave the search in the same place: the rows below only
+// depend on the remaining column counts, the last two rows (for dead ends, monsters and wide
+// spaces), the treasure room centers that are still possible, the walls already placed around
+// those rooms and which open cells in the last row are connected through the rows above. A table
+// of those states and how many solutions there are below them lets a search skip the states it's
+// already been through. The row solver only adds the states that had no solutions (nogoods),
+// `count_solutions` adds all of them. It's a fixed size table where a new state replaces whatever
+// was in its entry, and each search bumps the generation instead of clearing it.
+
+#define ROW_STATE_KEY_SIZE 4
+
+typedef struct {
+    u64 generation;
+    u64 key[ROW_STATE_KEY_SIZE];
+    u64 num_solutions;
+} RowStateEntry;
+
+typedef struct {
+    RowStateEntry *entries;
+    u64 mask;
+    u64 generation;
+    u64 hits;
+} RowStateTable;
+
+// Makes a table with room for at least `capacity` states. Returns false if out of memory.
+bool row_state_table_init(RowStateTable *table, u64 capacity) {
+    u64 num_entries = 1;
+    while (num_entries < capacity) {
+        num_entries *= 2;
+    }
+    *table = (RowStateTable){.entries = calloc(num_entries, sizeof(RowStateEntry)),
+                             .mask = num_entries - 1};
+    return table->entries != NULL;
+}
+
+void row_state_table_free(RowStateTable *table) {
+    free(table->entries);
+    *table = (RowStateTable){0};
+}
+
+// The open cells of `row` split up by which ones are connected through the open cells of the rows
+// above, a byte for each group. Bit 32 is set if there are open cells above that aren't connected
+// to the row at all, which can only happen if the row is all walls.
+u64 row_connections(u64 solution, i32 row) {
+    u64 open = ~solution & ~(u64)0 << (56 - 8 * row);
+    u64 row_open = open & row_board(0xFF, row);
+    u64 connections = open && !row_open ? (u64)1 << 32 : 0;
+    for (i32 i = 0; row_open; i++) {
+        u64 group = board_flood(slot_set(0, first_set_slot(row_open)), open);
+        row_open &= ~group;
+        connections |= (u64)board_row(group, row) << (8 * i);
+    }
+    return connections;
+}
+
+// The state of the search after placing `row`.
+void row_state_key(u64 key[ROW_STATE_KEY_SIZE], const TreasureState *treasures, ColCounts counts,
+                   u64 solution, i32 row) {
+    u64 centers = treasures->treasures ? treasures->centers[row * 8 + 8] : 0;
+    u64 room_walls = 0;
+    for (u64 remaining = centers; remaining;) {
+        i32 center = first_set_slot(remaining);
+        remaining = slot_unset(remaining, center);
+        room_walls |= masks.room_walls[center];
+    }
+    u64 last_rows = row > 0 ? board_row(solution, row - 1) : 0;
+    last_rows = last_rows << 8 | board_row(solution, row);
+    key[0] = (u64)row | (u64)counts.bits[0] << 8 | (u64)counts.bits[1] << 16 |
+             (u64)counts.bits[2] << 24 | (u64)counts.bits[3] << 32 | last_rows << 40;
+    key[1] = centers;
+    key[2] = solution & room_walls;
+    key[3] = row_connections(solution, row);
+}
+
+RowStateEntry *row_state_entry(RowStateTable *table, const u64 key[ROW_STATE_KEY_SIZE]) {
+    u64 hash = 0;
+    for (i32 i = 0; i < ROW_STATE_KEY_SIZE; i++) {
+        hash = mix_u64(hash ^ key[i]);
+    }
+    return &table->entries[hash & table->mask];
+}
+
+// Looks a state up from this search, returns false if it's not there.
+bool row_state_find(RowStateTable *table, const u64 key[ROW_STATE_KEY_SIZE], u64 *num_solutions) {
+    RowStateEntry *entry = row_state_entry(table, key);
+    if (entry->generation != table->generation ||
+        memcmp(entry->key, key, sizeof(entry->key)) != 0) {
+        return false;
+    }
+    table->hits++;
+    *num_solutions = entry->num_solutions;
+    return true;
+}
+
+void row_state_add(RowStateTable *table, const u64 key[ROW_STATE_KEY_SIZE], u64 num_solutions) {
+    RowStateEntry *entry = row_state_entry(table, key);
+    entry->generation = table->generation;
+    memcpy(entry->key, key, sizeof(entry->key));
+    entry->num_solutions = num_solutions;
+}
+
+// Starts a new search with the table, forgetting every state from the last one.
+void row_state_table_reset(RowStateTable *table) {
+    // Zero is never a generation so a fresh table starts out empty.
+    table->generation++;
+}
+
+// `solve_rows`, skipping the states in `nogoods` (if it's not NULL) and adding the ones it finds.
+SolveResult solve_rows_nogoods(Puzzle puzzle, u64 *solutions, u64 max_solutions, SolveMode mode,
+                               RowStateTable *nogoods) {
+    init_masks();
+    SolutionBuffer buffer = {.solutions = solutions,
+                             .max_solutions = max_solutions,
+                             .stop_after = solve_mode_limit(mode)};
+    RowPuzzle rows = row_puzzle(puzzle);
+    if (!check_row_puzzle(&rows)) {
+        return (SolveResult){0};
+    }
+    TreasureState treasures;
+    treasure_state_init(&treasures, puzzle, 0, 0);
+    if (nogoods) {
+        row_state_table_reset(nogoods);
+    }
+
+    // The next pattern to try and the remaining column counts, for each row.
+    u16 next_pattern[8];
+    u16 end_pattern[8];
+    ColCounts counts[9];
+    u64 solution = 0;
+    // The state after each row, and how many solutions had been found before the rows below it.
+    u64 keys[8][ROW_STATE_KEY_SIZE];
+    u64 found_before[8];
+
+    counts[0] = col_counts(puzzle);
+    i32 row = 0;
+    next_pattern[0] = row_patterns.start[puzzle.row_wall_counts[0]];
+    end_pattern[0] = row_patterns.start[puzzle.row_wall_counts[0] + 1];
+    while (row >= 0) {
+        if (next_pattern[row] == end_pattern[row]) {
+            row--;
+            if (nogoods && row >= 0 && buffer.num_solutions == found_before[row]) {
+                row_state_add(nogoods, keys[row], 0);
+            }
+            continue;
+        }
+        u8 pattern = row_patterns.patterns[next_pattern[row]++];
+
+        // Columns that need a wall in every row left must get one, and columns that are full
+        // can't get any more.
+        u8 needed = col_counts_equal(counts[row], 8 - row);
+        u8 full = col_counts_equal(counts[row], 0);
+        if ((pattern & needed) != needed || pattern & full || pattern & rows.occupied[row]) {
+            continue;
+        }
+        u64 rows_above = row > 0 ? solution & ~(~(u64)0 >> (8 * row)) : 0;
+        solution = rows_above | row_board(pattern, row);
+        if (!check_row(&rows, &treasures, solution, row)) {
+            continue;
+        }
+
+        // Move on to the next row.
+        if (row < 7) {
+            counts[row + 1] = col_counts_subtract(counts[row], pattern);
+            if (nogoods) {
+                u64 num_solutions;
+                row_state_key(keys[row], &treasures, counts[row + 1], solution, row);
+                if (row_state_find(nogoods, keys[row], &num_solutions)) {
+                    continue;
+                }
+                found_before[row] = buffer.num_solutions;
+            }
+            row++;
+            next_pattern[row] = row_patterns.start[puzzle.row_wall_counts[row]];
+            end_pattern[row] = row_patterns.start[puzzle.row_wall_counts[row] + 1];
+            continue;
+        }
+
+        // This is a valid solution!
+        if (!record_solution(&buffer, solution)) {
+            break;
+        }
+    }
+
+    return (SolveResult){.num_solutions = buffer.num_solutions,
+                         .hit_max = buffer.num_solutions > max_solutions};
+}
+
+// Solve a puzzle a row at a time. Takes the same arguments and finds the same solutions, in the
+// same order, as `solve`.
+SolveResult solve_rows(Puzzle puzzle, u64 *solutions, u64 max_solutions, SolveMode mode) {
+    return solve_rows_nogoods(puzzle, solutions, max_solutions, mode, NULL);
+}
+
+// Count the solutions to a puzzle, however many there are, without finding them one by one.
+// It's the row solver over row states: the count for a state is the sum of the counts for the
+// states its next rows lead to, and each one is counted once (as long as it stays in `states`,
+// which can be NULL to recount every time).
+u64 count_solutions_with(Puzzle puzzle, RowStateTable *states) {
+    init_masks();
+    RowPuzzle rows = row_puzzle(puzzle);
+    if (!check_row_puzzle(&rows)) {
+        return 0;
+    }
+    TreasureState treasures;
+    treasure_state_init(&treasures, puzzle, 0, 0);
+    if (states) {
+        row_state_table_reset(states);
+    }
+
+    u16 next_pattern[8];
+    u16 end_pattern[8];
+    ColCounts counts[9];
+    u64 solution = 0;
+    u64 keys[8][ROW_STATE_KEY_SIZE];
+    // The number of solutions found so far below the rows above each row.
+    u64 num_below[8];
+
+    counts[0] = col_counts(puzzle);
+    i32 row = 0;
+    next_pattern[0] = row_patterns.start[puzzle.row_wall_counts[0]];
+    end_pattern[0] = row_patterns.start[puzzle.row_wall_counts[0] + 1];
+    num_below[0] = 0;
+    for (;;) {
+        if (next_pattern[row] == end_pattern[row]) {
+            if (row == 0) {
+                return num_below[0];
+            }
+            row--;
+            if (states) {
+                row_state_add(states, keys[row], num_below[row + 1]);
+            }
+            num_below[row] += num_below[row + 1];
+            continue;
+        }
+        u8 pattern = row_patterns.patterns[next_pattern[row]++];
+
+        u8 needed = col_counts_equal(counts[row], 8 - row);
+        u8 full = col_counts_equal(counts[row], 0);
+        if ((pattern & needed) != needed || pattern & full || pattern & rows.occupied[row]) {
+            continue;
+        }
+        u64 rows_above = row > 0 ? solution & ~(~(u64)0 >> (8 * row)) : 0;
+        solution = rows_above | row_board(pattern, row);
+        if (!check_row(&rows, &treasures, solution, row)) {
+            continue;
+        }
+        if (row == 7) {
+            num_below[7]++;
+            continue;
+        }
+
+        counts[row + 1] = col_counts_subtract(counts[row], pattern);
+        if (states) {
+            u64 num_solutions;
+            row_state_key(keys[row], &treasures, counts[row + 1], solution, row);
+            if (row_state_find(states, keys[row], &num_solutions)) {
+                num_below[row] += num_solutions;
+                continue;
+            }
+        }
+        row++;
+        next_pattern[row] = row_patterns.start[puzzle.row_wall_counts[row]];
+        end_pattern[row] = row_patterns.start[puzzle.row_wall_counts[row] + 1];
+        num_below[row] = 0;
+    }
+}
+
+#define COUNT_SOLUTIONS_STATES 1024
+
+// Count the solutions to a puzzle. The same as the number `solve` finds with SOLVE_ALL.
+u64 count_solutions(Puzzle puzzle) {
+    RowStateTable states;
+    if (!row_state_table_init(&states, COUNT_SOLUTIONS_STATES)) {
+        return count_solutions_with(puzzle, NULL);
+    }
+    u64 num_solutions = count_solutions_with(puzzle, &states);
+    row_state_table_free(&states);
+    return num_solutions;
+}
+
+// Propagating solver.
+// Before branching, this fills in every cell that the constraints force, working on the cells
+// known to be walls and the cells known to be open. Then it only branches on a cell that's still
+// unknown. Unknown cells are allowed to go either way in all the checks.
+
+typedef struct {
+    u64 walls;
+    u64 open;
+} PartialSolution;
+
+// Force the cells of a row or column (`line`) if its count leaves no choice.
+bool propagate_line(PartialSolution *ps, u64 line, i32 wall_count) {
+    u64 unknown = line & ~(ps->walls | ps->open);
+    i32 missing = wall_count - count_set_bits(line & ps->walls);
+    i32 num_unknown = count_set_bits(unknown);
+    if (missing < 0 || missing > num_unknown) {
+        return false;
+    }
+    if (missing == 0) {
+        ps->open |= unknown;
+    } else if (missing == num_unknown) {
+        ps->walls |= unknown;
+    }
+    return true;
+}
+
+// Fill in every cell that's forced, until nothing changes. Returns false if the partial solution
+// can't be completed.
+bool propagate(Puzzle puzzle, PartialSolution *ps) {
+    u64 occupied = puzzle.monsters | puzzle.treasures;
+    // Monsters and treasures are always open.
+    ps->open |= occupied;
+    for (;;) {
+        u64 walls = ps->walls;
+        u64 open = ps->open;
+        if (walls & open) {
+            return false;
+        }
+
+        // Rows and columns that need all or none of their unknown cells as walls.
+        for (i32 i = 0; i < 8; i++) {
+            u64 row_mask = row_board(0xFF, i);
+            u64 col_mask = BOARD_COL_0 >> i;
+            if (!propagate_line(ps, row_mask, puzzle.row_wall_counts[i]) ||
+                !propagate_line(ps, col_mask, puzzle.col_wall_counts[i])) {
+                return false;
+            }
+        }
+
+        u64 unknown = ~(ps->walls | ps->open);
+        // Cells that could still be open.
+        u64 maybe_open = ~ps->walls;
+
+        // Monsters need exactly one way out. Once they have it, the rest are walls. If they only
+        // have one possible way out left, it has to be open.
+        u64 monsters = puzzle.monsters;
+        if (monsters & (board_two_open_neighbors(ps->open) | board_neighbors(occupied) |
+                        ~(board_two_open_neighbors(maybe_open) |
+                          board_one_open_neighbor(maybe_open)))) {
+            return false;
+        }
+        u64 monsters_with_exit = monsters & board_one_open_neighbor(ps->open);
+        ps->walls |= unknown & board_neighbors(monsters_with_exit);
+        u64 monsters_one_way = monsters & ~monsters_with_exit & board_one_open_neighbor(maybe_open);
+        ps->open |= unknown & board_neighbors(monsters_one_way);
+
+        // Open cells without a monster or treasure need at least 2 ways out, so if they only have
+        // 2 possible ways out they're both open. An unknown cell that couldn't have 2 ways out
+        // has to be a wall.
+        u64 empty = ps->open & ~occupied;
+        u64 two_ways = board_two_open_neighbors(maybe_open);
+        if (empty & ~two_ways) {
+            return false;
+        }
+        u64 only_two_ways = empty & ~board_three_open_neighbors(maybe_open);
+        ps->open |= unknown & board_neighbors(only_two_ways);
+        ps->walls |= unknown & ~occupied & ~two_ways;
+
+        // 2x2 spaces that aren't allowed. If 3 of the cells are open and empty the 4th is a wall.
+        // Spaces are found by their bottom right corner, `corners` is where they fit on the board.
+        u64 corners = ~BOARD_COL_0 & (~(u64)0 >> 8);
+        u64 disallowed = corners & ~board_allowed_wide_spaces(puzzle.treasures);
+        u64 here = empty;
+        u64 left = board_from_left(empty);
+        u64 above = board_from_above(empty);
+        u64 above_left = board_from_above(left);
+        if (disallowed & here & left & above & above_left) {
+            return false;
+        }
+        u64 unknown_here = unknown;
+        u64 unknown_left = board_from_left(unknown);
+        u64 unknown_above = board_from_above(unknown);
+        u64 unknown_above_left = board_from_above(unknown_left);
+        ps->walls |= disallowed & unknown_here & left & above & above_left;
+        ps->walls |= board_from_right(disallowed & here & unknown_left & above & above_left);
+        ps->walls |= board_from_below(disallowed & here & left & unknown_above & above_left);
+        ps->walls |= board_from_below(
+            board_from_right(disallowed & here & left & above & unknown_above_left));
+
+        // Treasure rooms can't be checked much until they're filled in, but the rooms that
+        // already have walls in them or are shut in are ruled out. Checking from slot 0 only
+        // rules those out.
+        if (!check_treasure_rooms(puzzle, ps->walls, 0)) {
+            return false;
+        }
+
+        if (ps->walls == walls && ps->open == open) {
+            return !(walls & open);
+        }
+    }
+}
+
+// How hard a puzzle is, measured by how much of it the propagating solver gets without guessing
+// and how much guessing it takes to prove the solution is unique.
+typedef struct {
+    // Cells the constraints force before the first branch (not counting monsters and treasures).
+    u32 forced_cells;
+    // Cells the solver branched on, over the whole search.
+    u32 branches;
+    // The most branches deep the search went.
+    u32 max_depth;
+} PuzzleScore;
+
+// `solve_propagate`, also scoring the search into `score` if it isn't NULL.
+SolveResult solve_propagate_with_score(Puzzle puzzle, u64 *solutions, u64 max_solutions,
+                                       SolveMode mode, PuzzleScore *score) {
+    init_masks();
+    SolutionBuffer buffer = {.solutions = solutions,
+                             .max_solutions = max_solutions,
+                             .stop_after = solve_mode_limit(mode)};
+    PuzzleScore search_score = {0};
+    i32 given = count_set_bits(puzzle.monsters | puzzle.treasures);
+
+    // Every branch leaves one sibling on the stack, so it never holds more than 1 per slot.
+    PartialSolution stack[65];
+    u32 depths[65];
+    i32 stack_len = 0;
+    stack[stack_len] = (PartialSolution){0};
+    depths[stack_len++] = 0;
+    while (stack_len > 0) {
+        stack_len--;
+        PartialSolution ps = stack[stack_len];
+        u32 depth = depths[stack_len];
+        bool ok = propagate(puzzle, &ps);
+        if (depth == 0) {
+            search_score.forced_cells = ok ? (u32)(count_set_bits(ps.walls | ps.open) - given) : 0;
+        }
+        if (!ok) {
+            continue;
+        }
+        search_score.max_depth = depth > search_score.max_depth ? depth : search_score.max_depth;
+        u64 unknown = ~(ps.walls | ps.open);
+        if (!unknown) {
+            if (validate(puzzle, ps.walls) && !record_solution(&buffer, ps.walls)) {
+                break;
+            }
+            continue;
+        }
+        i32 slot = first_set_slot(unknown);
+        search_score.branches++;
+        assert(stack_len + 2 <= 65);
+        stack[stack_len] = (PartialSolution){.walls = ps.walls, .open = slot_set(ps.open, slot)};
+        depths[stack_len++] = depth + 1;
+        stack[stack_len] = (PartialSolution){.walls = slot_set(ps.walls, slot), .open = ps.open};
+        depths[stack_len++] = depth + 1;
+    }
+
+    if (score) {
+        *score = search_score;
+    }
+    return (SolveResult){.num_solutions = buffer.num_solutions,
+                         .hit_max = buffer.num_solutions > max_solutions};
+}
+
+// Solve a puzzle by propagating forced cells and branching on the first unknown cell, trying a
+// wall first. Takes the same arguments and finds the same solutions, in the same order, as `solve`.
+SolveResult solve_propagate(Puzzle puzzle, u64 *solutions, u64 max_solutions, SolveMode mode) {
+    return solve_propagate_with_score(puzzle, solutions, max_solutions, mode, NULL);
+}
+
+// Difficulty scoring.
+// Run `solve_propagate`'s search on the puzzle, stopping at the second solution like
+// `SOLVE_UNIQUE`, and score it. Sets `num_solutions` to 0, 1 or 2 if it has more than 1.
+PuzzleScore score_puzzle(Puzzle puzzle, u64 *num_solutions) {
+    PuzzleScore score;
+    SolveResult result = solve_propagate_with_score(puzzle, NULL, 0, SOLVE_UNIQUE, &score);
+    *num_solutions = result.num_solutions;
+    return score;
+}
+
+// The scores to keep, every field of a score has to be between the fields of `min` and `max`.
+typedef struct {
+    PuzzleScore min;
+    PuzzleScore max;
+} ScoreRange;
+
+// Every score, for scoring without filtering.
+const ScoreRange score_range_all = {.max = {UINT32_MAX, UINT32_MAX, UINT32_MAX}};
+
+bool score_in_range(PuzzleScore score, const ScoreRange *range) {
+    return range->min.forced_cells <= score.forced_cells &&
+           score.forced_cells <= range->max.forced_cells &&
+           range->min.branches <= score.branches && score.branches <= range->max.branches &&
+           range->min.max_depth <= score.max_depth && score.max_depth <= range->max.max_depth;
+}
+
+// Bigger boards.
+// Everything above is for 8x8 boards in a single u64, and that stays the fast path. Bigger boards
+// (for a harder tier of puzzles) are a number of u64 words with the same layout, slot 0 in the top
+// bit of the first word. DEFINE_BOARD_SIZE(N) defines a BoardN and a PuzzleN for N x N boards and
+// the whole board kernels, `validate_NxN` and `solve_NxN` for them. The kernels are the same as
+// the 8x8 ones, but shifts carry bits between words and cells past the end of the board are
+// masked off. Every size gets its own copies, with N and the number of words as constants, so
+// nothing checks the size at runtime.
+
+#define BOARD_WORDS(n) (((n) * (n) + 63) / 64)
+
+#define DEFINE_BOARD_SIZE(N)                                                                       \
+typedef struct {                                                                                   \
+    u64 words[BOARD_WORDS(N)];                                                                     \
+} Board##N;                                                                                        \
+                                                                                                   \
+typedef struct {                                                                                   \
+    u8 row_wall_counts[N];                                                                         \
+    u8 col_wall_counts[N];                                                                         \
+    Board##N monsters;                                                                             \
+    Board##N treasures;                                                                            \
+} Puzzle##N;                                                                                       \
+                                                                                                   \
+static Board##N board##N##_cells;                                                                  \
+static Board##N board##N##_col_first;                                                              \
+static Board##N board##N##_col_last;                                                               \
+static Once board##N##_masks_once = ONCE_INIT;                                                     \
+                                                                                                   \
+Board##N board##N##_set(Board##N board, i32 slot) {                                                \
+    board.words[slot / 64] |= (u64)1 << (63 - slot % 64);                                          \
+    return board;                                                                                  \
+}                                                                                                  \
+                                                                                                   \
+Board##N board##N##_unset(Board##N board, i32 slot) {                                              \
+    board.words[slot / 64] &= ~((u64)1 << (63 - slot % 64));                                       \
+    return board;                                                                                  \
+}                                                                                                  \
+                                                                                                   \
+u64 board##N##_is_set(Board##N board, i32 slot) {                                                  \
+    return board.words[slot / 64] & (u64)1 << (63 - slot % 64);                                    \
+}                                                                                                  \
+                                                                                                   \
+void board##N##_build_masks(void) {                                                                \
+    for (i32 slot = 0; slot < N * N; slot++) {                                                     \
+        board##N##_cells = board##N##_set(board##N##_cells, slot);                                 \
+        if (slot % N == 0) {                                                                       \
+            board##N##_col_first = board##N##_set(board##N##_col_first, slot);                     \
+        }                                                                                          \
+        if (slot % N == N - 1) {                                                                   \
+            board##N##_col_last = board##N##_set(board##N##_col_last, slot);                       \
+        }                                                                                          \
+    }                                                                                              \
+}                                                                                                  \
+                                                                                                   \
+void board##N##_init_masks(void) {                                                                 \
+    run_once(&board##N##_masks_once, board##N##_build_masks);                                      \
+}                                                                                                  \
+                                                                                                   \
+Board##N board##N##_and(Board##N a, Board##N b) {                                                  \
+    for (i32 i = 0; i < BOARD_WORDS(N); i++) {                                                     \
+        a.words[i] &= b.words[i];                                                                  \
+    }                                                                                              \
+    return a;                                                                                      \
+}                                                                                                  \
+                                                                                                   \
+Board##N board##N##_or(Board##N a, Board##N b) {                                                   \
+    for (i32 i = 0; i < BOARD_WORDS(N); i++) {                                                     \
+        a.words[i] |= b.words[i];                                                                  \
+    }                                                                                              \
+    return a;                                                                                      \
+}                                                                                                  \
+                                                                                                   \
+/* The cells of `a` that aren't in `b`. */                                                         \
+Board##N board##N##_andnot(Board##N a, Board##N b) {                                               \
+    for (i32 i = 0; i < BOARD_WORDS(N); i++) {                                                     \
+        a.words[i] &= ~b.words[i];                                                                 \
+    }                                                                                              \
+    return a;                                                                                      \
+}                                                                                                  \
+                                                                                                   \
+/* The cells on the board that aren't in `board`. */                                               \
+Board##N board##N##_not(Board##N board) {                                                          \
+    return board##N##_andnot(board##N##_cells, board);                                             \
+}                                                                                                  \
+                                                                                                   \
+bool board##N##_is_empty(Board##N board) {                                                         \
+    u64 any = 0;                                                                                   \
+    for (i32 i = 0; i < BOARD_WORDS(N); i++) {                                                     \
+        any |= board.words[i];                                                                     \
+    }                                                                                              \
+    return !any;                                                                                   \
+}                                                                                                  \
+                                                                                                   \
+bool board##N##_equal(Board##N a, Board##N b) {                                                    \
+    u64 diff = 0;                                                                                  \
+    for (i32 i = 0; i < BOARD_WORDS(N); i++) {                                                     \
+        diff |= a.words[i] ^ b.words[i];                                                           \
+    }                                                                                              \
+    return !diff;                                                                                  \
+}                                                                                                  \
+                                                                                                   \
+i32 board##N##_count(Board##N board) {                                                             \
+    i32 count = 0;                                                                                 \
+    for (i32 i = 0; i < BOARD_WORDS(N); i++) {                                                     \
+        count += count_set_bits(board.words[i]);                                                   \
+    }                                                                                              \
+    return count;                                                                                  \
+}                                                                                                  \
+                                                                                                   \
+/* The first slot that's set, `board` must not be empty. */                                        \
+i32 board##N##_first_slot(Board##N board) {                                                        \
+    i32 i = 0;                                                                                     \
+    while (!board.words[i]) {                                                                      \
+        i++;                                                                                       \
+    }                                                                                              \
+    return i * 64 + first_set_slot(board.words[i]);                                                \
+}                                                                                                  \
+                                                                                                   \
+/* The first `rows` rows of the board. */                                                          \
+Board##N board##N##_first_rows(i32 rows) {                                                         \
+    Board##N board;                                                                                \
+    for (i32 i = 0; i < BOARD_WORDS(N); i++) {                                                     \
+        i32 bits = rows * N - 64 * i;                                                              \
+        board.words[i] = bits <= 0 ? 0 : bits >= 64 ? ~(u64)0 : ~(u64)0 << (64 - bits);            \
+    }                                                                                              \
+    return board;                                                                                  \
+}                                                                                                  \
+                                                                                                   \
+/* Move every cell `shift` slots later (0 < shift < 64), carrying between the words. */            \
+Board##N board##N##_later(Board##N board, i32 shift) {                                             \
+    Board##N moved;                                                                                \
+    for (i32 i = 0; i < BOARD_WORDS(N); i++) {                                                     \
+        moved.words[i] = board.words[i] >> shift;                                                  \
+        if (i > 0) {                                                                               \
+            moved.words[i] |= board.words[i - 1] << (64 - shift);                                  \
+        }                                                                                          \
+    }                                                                                              \
+    return board##N##_and(moved, board##N##_cells);                                                \
+}                                                                                                  \
+                                                                                                   \
+/* Move every cell `shift` slots earlier (0 < shift < 64). */                                      \
+Board##N board##N##_earlier(Board##N board, i32 shift) {                                           \
+    Board##N moved;                                                                                \
+    for (i32 i = 0; i < BOARD_WORDS(N); i++) {                                                     \
+        moved.words[i] = board.words[i] << shift;                                                  \
+        if (i + 1 < BOARD_WORDS(N)) {                                                              \
+            moved.words[i] |= board.words[i + 1] >> (64 - shift);                                  \
+        }                                                                                          \
+    }                                                                                              \
+    return moved;                                                                                  \
+}                                                                                                  \
+                                                                                                   \
+Board##N board##N##_from_above(Board##N board) {                                                   \
+    return board##N##_later(board, N);                                                             \
+}                                                                                                  \
+                                                                                                   \
+Board##N board##N##_from_below(Board##N board) {                                                   \
+    return board##N##_earlier(board, N);                                                           \
+}                                                                                                  \
+                                                                                                   \
+Board##N board##N##_from_left(Board##N board) {                                                    \
+    return board##N##_andnot(board##N##_later(board, 1), board##N##_col_first);                    \
+}                                                                                                  \
+                                                                                                   \
+Board##N board##N##_from_right(Board##N board) {                                                   \
+    return board##N##_andnot(board##N##_earlier(board, 1), board##N##_col_last);                   \
+}                                                                                                  \
+                                                                                                   \
+Board##N board##N##_neighbors(Board##N board) {                                                    \
+    return board##N##_or(                                                                          \
+        board##N##_or(board##N##_from_above(board), board##N##_from_below(board)),                 \
+        board##N##_or(board##N##_from_left(board), board##N##_from_right(board)));                 \
+}                                                                                                  \
+                                                                                                   \
+Board##N board##N##_flood(Board##N seed, Board##N region) {                                        \
+    seed = board##N##_and(seed, region);                                                           \
+    for (;;) {                                                                                     \
+        Board##N grown = board##N##_and(board##N##_or(seed, board##N##_neighbors(seed)), region);  \
+        if (board##N##_equal(grown, seed)) {                                                       \
+            return seed;                                                                           \
+        }                                                                                          \
+        seed = grown;                                                                              \
+    }                                                                                              \
+}                                                                                                  \
+                                                                                                   \
+bool board##N##_is_connected(Board##N open) {                                                      \
+    if (board##N##_is_empty(open)) {                                                               \
+        return true;                                                                               \
+    }                                                                                              \
+    Board##N seed = board##N##_set((Board##N){0}, board##N##_first_slot(open));                    \
+    return board##N##_equal(board##N##_flood(seed, open), open);                                   \
+}                                                                                                  \
+                                                                                                   \
+/* Cells with at least 2 open neighbors, and with exactly 1. */                                    \
+Board##N board##N##_two_open_neighbors(Board##N open) {                                            \
+    Board##N above = board##N##_from_above(open);                                                  \
+    Board##N below = board##N##_from_below(open);                                                  \
+    Board##N left = board##N##_from_left(open);                                                    \
+    Board##N right = board##N##_from_right(open);                                                  \
+    Board##N result;                                                                               \
+    for (i32 i = 0; i < BOARD_WORDS(N); i++) {                                                     \
+        u64 sum0 = above.words[i] ^ below.words[i];                                                \
+        u64 carry0 = above.words[i] & below.words[i];                                              \
+        u64 sum1 = left.words[i] ^ right.words[i];                                                 \
+        u64 carry1 = left.words[i] & right.words[i];                                               \
+        result.words[i] = carry0 | carry1 | (sum0 & sum1);                                         \
+    }                                                                                              \
+    return result;                                                                                 \
+}                                                                                                  \
+                                                                                                   \
+Board##N board##N##_one_open_neighbor(Board##N open) {                                             \
+    Board##N above = board##N##_from_above(open);                                                  \
+    Board##N below = board##N##_from_below(open);                                                  \
+    Board##N left = board##N##_from_left(open);                                                    \
+    Board##N right = board##N##_from_right(open);                                                  \
+    Board##N result;                                                                               \
+    for (i32 i = 0; i < BOARD_WORDS(N); i++) {                                                     \
+        u64 sum0 = above.words[i] ^ below.words[i];                                                \
+        u64 carry0 = above.words[i] & below.words[i];                                              \
+        u64 sum1 = left.words[i] ^ right.words[i];                                                 \
+        u64 carry1 = left.words[i] & right.words[i];                                               \
+        result.words[i] = (sum0 ^ sum1) & ~(carry0 | carry1);                                      \
+    }                                                                                              \
+    return result;                                                                                 \
+}                                                                                                  \
+                                                                                                   \
+Board##N board##N##_allowed_wide_spaces(Board##N treasures) {                                      \
+    Board##N left = board##N##_from_left(treasures);                                               \
+    Board##N spread = board##N##_or(board##N##_or(treasures, left),                                \
+                                    board##N##_or(board##N##_from_left(left),                      \
+                                                  board##N##_from_right(treasures)));              \
+    Board##N above = board##N##_from_above(spread);                                                \
+    return board##N##_or(board##N##_or(spread, above),                                             \
+                         board##N##_or(board##N##_from_above(above),                               \
+                                       board##N##_from_below(spread)));                            \
+}                                                                                                  \
+                                                                                                   \
+Board##N board##N##_dead_ends(const Puzzle##N *puzzle, Board##N solution) {                        \
+    Board##N open = board##N##_not(solution);                                                      \
+    Board##N empty = board##N##_andnot(open, board##N##_or(puzzle->monsters, puzzle->treasures));  \
+    return board##N##_andnot(empty, board##N##_two_open_neighbors(open));                          \
+}                                                                                                  \
+                                                                                                   \
+Board##N board##N##_invalid_monsters(const Puzzle##N *puzzle, Board##N solution) {                 \
+    Board##N open = board##N##_not(solution);                                                      \
+    Board##N next_to_occupied =                                                                    \
+        board##N##_neighbors(board##N##_or(puzzle->monsters, puzzle->treasures));                  \
+    Board##N bad = board##N##_or(next_to_occupied,                                                 \
+                                 board##N##_not(board##N##_one_open_neighbor(open)));              \
+    return board##N##_and(puzzle->monsters, bad);                                                  \
+}                                                                                                  \
+                                                                                                   \
+Board##N board##N##_invalid_wide_spaces(const Puzzle##N *puzzle, Board##N solution) {              \
+    Board##N empty = board##N##_andnot(board##N##_not(solution),                                   \
+                                       board##N##_or(puzzle->monsters, puzzle->treasures));        \
+    Board##N columns = board##N##_and(empty, board##N##_from_above(empty));                        \
+    Board##N spaces = board##N##_and(columns, board##N##_from_left(columns));                      \
+    return board##N##_andnot(spaces, board##N##_allowed_wide_spaces(puzzle->treasures));           \
+}                                                                                                  \
+                                                                                                   \
+/* Whether the treasure at `treasure` is in a room: an empty 3x3 space with no walls, monsters */  \
+/* or other treasures, and exactly one open cell around it. */                                     \
+bool board##N##_treasure_has_room(const Puzzle##N *puzzle, Board##N solution, i32 treasure) {      \
+    Board##N occupied = board##N##_or(puzzle->monsters, puzzle->treasures);                        \
+    Board##N others = board##N##_unset(occupied, treasure);                                        \
+    i32 row = treasure / N;                                                                        \
+    i32 col = treasure % N;                                                                        \
+    for (i32 center_row = row - 1; center_row <= row + 1; center_row++) {                          \
+        for (i32 center_col = col - 1; center_col <= col + 1; center_col++) {                      \
+            if (center_row < 1 || center_row > N - 2 || center_col < 1 || center_col > N - 2) {    \
+                continue;                                                                          \
+            }                                                                                      \
+            Board##N room = {0};                                                                   \
+            for (i32 cell = 0; cell < 9; cell++) {                                                 \
+                room = board##N##_set(room, (center_row - 1 + cell / 3) * N + center_col - 1 +     \
+                                                cell % 3);                                         \
+            }                                                                                      \
+            Board##N walls = board##N##_andnot(board##N##_neighbors(room), room);                  \
+            if (board##N##_is_empty(board##N##_and(room, board##N##_or(others, solution))) &&      \
+                board##N##_is_empty(board##N##_and(walls, occupied)) &&                            \
+                board##N##_count(board##N##_andnot(walls, solution)) == 1) {                       \
+                return true;                                                                       \
+            }                                                                                      \
+        }                                                                                          \
+    }                                                                                              \
+    return false;                                                                                  \
+}                                                                                                  \
+                                                                                                   \
+/* The puzzle for a finished board, from its N * N tiles in row-major order: `X` for a wall, */    \
+/* `M` for a monster, `T` for a treasure and anything else for an empty cell. The wall counts */   \
+/* come from the walls, which are also put in `solution`. */                                       \
+Puzzle##N puzzle##N##_from_tiles(const char *tiles, Board##N *solution) {                          \
+    Puzzle##N puzzle = {0};                                                                        \
+    *solution = (Board##N){0};                                                                     \
+    for (i32 slot = 0; slot < N * N; slot++) {                                                     \
+        if (tiles[slot] == 'X') {                                                                  \
+            *solution = board##N##_set(*solution, slot);                                           \
+            puzzle.row_wall_counts[slot / N]++;                                                    \
+            puzzle.col_wall_counts[slot % N]++;                                                    \
+        } else if (tiles[slot] == 'M') {                                                           \
+            puzzle.monsters = board##N##_set(puzzle.monsters, slot);                               \
+        } else if (tiles[slot] == 'T') {                                                           \
+            puzzle.treasures = board##N##_set(puzzle.treasures, slot);                             \
+        }                                                                                          \
+    }                                                                                              \
+    return puzzle;                                                                                 \
+}                                                                                                  \
+                                                                                                   \
+/* `validate_solution` for this board size. */                                                     \
+bool validate_##N##x##N(const Puzzle##N *puzzle, Board##N solution) {                              \
+    board##N##_init_masks();                                                                       \
+    solution = board##N##_and(solution, board##N##_cells);                                         \
+    if (!board##N##_is_empty(                                                                      \
+            board##N##_and(solution, board##N##_or(puzzle->monsters, puzzle->treasures)))) {       \
+        return false;                                                                              \
+    }                                                                                              \
+    u8 row_walls[N] = {0};                                                                         \
+    u8 col_walls[N] = {0};                                                                         \
+    for (i32 slot = 0; slot < N * N; slot++) {                                                     \
+        if (board##N##_is_set(solution, slot)) {                                                   \
+            row_walls[slot / N]++;                                                                 \
+            col_walls[slot % N]++;                                                                 \
+        }                                                                                          \
+    }                                                                                              \
+    if (memcmp(row_walls, puzzle->row_wall_counts, N) ||                                           \
+        memcmp(col_walls, puzzle->col_wall_counts, N)) {                                           \
+        return false;                                                                              \
+    }                                                                                              \
+    Board##N invalid = board##N##_or(board##N##_dead_ends(puzzle, solution),                       \
+                                     board##N##_invalid_monsters(puzzle, solution));               \
+    invalid = board##N##_or(invalid, board##N##_invalid_wide_spaces(puzzle, solution));            \
+    if (!board##N##_is_empty(invalid)) {                                                           \
+        return false;                                                                              \
+    }                                                                                              \
+    for (i32 slot = 0; slot < N * N; slot++) {                                                     \
+        if (board##N##_is_set(puzzle->treasures, slot) &&                                          \
+            !board##N##_treasure_has_room(puzzle, solution, slot)) {                               \
+            return false;                                                                          \
+        }                                                                                          \
+    }                                                                                              \
+    return board##N##_is_connected(board##N##_not(solution));                                      \
+}                                                                                                  \
+                                                                                                   \
+/* Checked when `row` is finished, with the walls of every row up to it placed. The cells in */    \
+/* the rows before it have all of their neighbors, so their dead ends and monsters are final */    \
+/* (all of them on the last row), and so are the 2x2 spaces that end in this row. The open */      \
+/* cells that can't reach the rows below are cut off for good, like in `check_connected`. */       \
+bool board##N##_rows_are_valid(const Puzzle##N *puzzle, Board##N walls, i32 row) {                 \
+    Board##N placed = board##N##_first_rows(row + 1);                                              \
+    Board##N final = row == N - 1 ? placed : board##N##_first_rows(row);                           \
+    Board##N invalid = board##N##_or(board##N##_dead_ends(puzzle, walls),                          \
+                                     board##N##_invalid_monsters(puzzle, walls));                  \
+    if (!board##N##_is_empty(board##N##_and(invalid, final)) ||                                    \
+        !board##N##_is_empty(                                                                      \
+            board##N##_and(board##N##_invalid_wide_spaces(puzzle, walls), placed))) {              \
+        return false;                                                                              \
+    }                                                                                              \
+    Board##N open = board##N##_andnot(placed, walls);                                              \
+    Board##N below = board##N##_not(placed);                                                       \
+    Board##N cut_off =                                                                             \
+        board##N##_andnot(open, board##N##_flood(below, board##N##_or(open, below)));              \
+    return board##N##_is_empty(cut_off) ||                                                         \
+           (board##N##_equal(cut_off, open) && board##N##_is_connected(cut_off));                  \
+}                                                                                                  \
+                                                                                                   \
+/* `solve` for this board size. It tries a wall and then an open cell in each slot, in slot */     \
+/* order, keeping running row and column counts, checks the rest of the rules whenever a row */    \
+/* is finished and checks every full board against all of them. */                                 \
+SolveResult solve_##N##x##N(Puzzle##N puzzle, Board##N *solutions, u64 max_solutions,              \
+                            SolveMode mode) {                                                      \
+    board##N##_init_masks();                                                                       \
+    u64 stop_after = solve_mode_limit(mode);                                                       \
+    u64 num_solutions = 0;                                                                         \
+    Board##N occupied = board##N##_or(puzzle.monsters, puzzle.treasures);                          \
+    Board##N walls = {0};                                                                          \
+    i32 row_walls[N] = {0};                                                                        \
+    i32 col_walls[N] = {0};                                                                        \
+    /* What each slot is set to: 0 before it's tried, then 1 for a wall and 2 for open. */         \
+    u8 tried[N * N] = {0};                                                                         \
+    i32 slot = 0;                                                                                  \
+    while (slot >= 0) {                                                                            \
+        if (slot == N * N) {                                                                       \
+            if (validate_##N##x##N(&puzzle, walls)) {                                              \
+                if (num_solutions < max_solutions) {                                               \
+                    solutions[num_solutions] = walls;                                              \
+                }                                                                                  \
+                num_solutions++;                                                                   \
+                if (stop_after && num_solutions >= stop_after) {                                   \
+                    break;                                                                         \
+                }                                                                                  \
+            }                                                                                      \
+            slot--;                                                                                \
+            continue;                                                                              \
+        }                                                                                          \
+        i32 row = slot / N;                                                                        \
+        i32 col = slot % N;                                                                        \
+        if (tried[slot] == 1) {                                                                    \
+            walls = board##N##_unset(walls, slot);                                                 \
+            row_walls[row]--;                                                                      \
+            col_walls[col]--;                                                                      \
+            tried[slot] = 2;                                                                       \
+        } else if (tried[slot] == 2) {                                                             \
+            tried[slot] = 0;                                                                       \
+            slot--;                                                                                \
+            continue;                                                                              \
+        } else if (board##N##_is_set(occupied, slot)) {                                            \
+            tried[slot] = 2;                                                                       \
+        } else {                                                                                   \
+            walls = board##N##_set(walls, slot);                                                   \
+            row_walls[row]++;                                                                      \
+            col_walls[col]++;                                                                      \
+            tried[slot] = 1;                                                                       \
+        }                                                                                          \
+        /* Too many walls, or not enough cells left to reach the count. */                         \
+        i32 row_count = puzzle.row_wall_counts[row];                                               \
+        i32 col_count = puzzle.col_wall_counts[col];                                               \
+        if (row_walls[row] > row_count || row_walls[row] + (N - 1 - col) < row_count ||            \
+            col_walls[col] > col_count || col_walls[col] + (N - 1 - row) < col_count) {            \
+            continue;                                                                              \
+        }                                                                                          \
+        if (col == N - 1 && !board##N##_rows_are_valid(&puzzle, walls, row)) {                     \
+            continue;                                                                              \
+        }                                                                                          \
+        slot++;                                                                                    \
+    }                                                                                              \
+    return (SolveResult){.num_solutions = num_solutions,                                           \
+                         .hit_max = num_solutions > max_solutions};                                \
+}
+
+// Every size that gets kernels. The self-check in main checks each of them against `solve`.
+#define BOARD_SIZES(X) X(10) X(12)
+
+BOARD_SIZES(DEFINE_BOARD_SIZE)
+
+typedef enum { EMPTY = 0, WALL = 1, MONSTER = 2, TREASURE = 3 } Tile;
+
+// A whole board of tiles as bitboards, for comparing boards.
+typedef struct {
+    u64 walls;
+    u64 monsters;
+    u64 treasures;
+} TileBoards;
+
+Tile tile_at(TileBoards board, i32 slot) {
+    if (slot_is_set(board.treasures, slot)) {
+        return TREASURE;
+    }
+    if (slot_is_set(board.monsters, slot)) {
+        return MONSTER;
+    }
+    return slot_is_set(board.walls, slot) ? WALL : EMPTY;
+}
+
+// Compares boards by their tiles in slot order, the order the generator finds boards in (from
+// the highest to the lowest).
+bool tiles_greater(TileBoards a, TileBoards b) {
+    u64 diff = (a.walls ^ b.walls) | (a.monsters ^ b.monsters) | (a.treasures ^ b.treasures);
+    if (!diff) {
+        return false;
+    }
+    i32 slot = first_set_slot(diff);
+    return tile_at(a, slot) > tile_at(b, slot);
+}
+
+TileBoards tiles_transform(TileBoards board, i32 symmetry) {
+    return (TileBoards){.walls = board_transform(board.walls, symmetry),
+                        .monsters = board_transform(board.monsters, symmetry),
+                        .treasures = board_transform(board.treasures, symmetry)};
+}
+
+TileBoards tiles_mask(TileBoards board, u64 mask) {
+    return (TileBoards){.walls = board.walls & mask,
+                        .monsters = board.monsters & mask,
+                        .treasures = board.treasures & mask};
+}
+
+// A board is canonical if none of its symmetries has greater tiles, so it's the first of them the
+// generator finds.
+bool is_canonical(TileBoards board) {
+    for (i32 symmetry = 1; symmetry < NUM_SYMMETRIES; symmetry++) {
+        if (tiles_greater(tiles_transform(board, symmetry), board)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+typedef struct {
+    // The generator's search for valid boards.
+    SolveStats search;
+    // The solves that check how many solutions each generated puzzle has.
+    SolveStats solve;
+} GenerateStats;
+
+// The state of the generator's search between the slots `first_slot` and `end_slot`. The slots
+// before `first_slot` are fixed. The search can stop at every valid board and pick back up from
+// there.
+typedef struct {
+    Tile puzzle_tiles[64];
+    // The monsters and treasures placed so far, the counts aren't used.
+    Puzzle puzzle;
+    // The walls placed so far.
+    u64 solution;
+    WallCounts counts;
+    i32 slot;
+    i32 first_slot;
+    i32 end_slot;
+    // Set when the state is stopped at a valid board.
+    bool found;
+    // Where to count what the search does in DANDD_STATS builds, can be NULL.
+    GenerateStats *stats;
+    // The order to run the checks in, NULL for `generate_checks`.
+    const CheckPipeline *checks;
+    // The generator only finds canonical boards unless this is set, see `is_canonical`.
+    bool all_symmetries;
+    // If set, puzzles are solved through the cache. A puzzle that isn't unique can come up again
+    // for its other solutions, so it saves solving those again.
+    SolveCache *cache;
+} GenState;
+
+// Put a tile in an empty slot.
+void gen_place(GenState *state, i32 slot, Tile tile) {
+    state->puzzle_tiles[slot] = tile;
+    if (tile == WALL) {
+        state->solution = slot_set(state->solution, slot);
+        wall_counts_set(&state->counts, slot);
+    } else if (tile == MONSTER) {
+        state->puzzle.monsters = slot_set(state->puzzle.monsters, slot);
+    } else if (tile == TREASURE) {
+        state->puzzle.treasures = slot_set(state->puzzle.treasures, slot);
+    }
+}
+
+// Take the tile back out of a slot, leaving it EMPTY.
+void gen_unplace(GenState *state, i32 slot) {
+    Tile tile = state->puzzle_tiles[slot];
+    state->puzzle_tiles[slot] = EMPTY;
+    if (tile == WALL) {
+        state->solution = slot_unset(state->solution, slot);
+        wall_counts_unset(&state->counts, slot);
+    } else if (tile == MONSTER) {
+        state->puzzle.monsters = slot_unset(state->puzzle.monsters, slot);
+    } else if (tile == TREASURE) {
+        state->puzzle.treasures = slot_unset(state->puzzle.treasures, slot);
+    }
+}
+
+// Start a search over the slots from `first_slot` up to (not including) `end_slot`, with the
+// slots before `first_slot` fixed to the tiles in `prefix` (which can be NULL if there aren't any).
+void gen_init(GenState *state, const Tile *prefix, i32 first_slot, i32 end_slot) {
+    assert(0 <= first_slot);
+    assert(first_slot < end_slot);
+    assert(end_slot <= 64);
+    init_masks();
+    *state = (GenState){.slot = first_slot, .first_slot = first_slot, .end_slot = end_slot};
+    for (i32 slot = 0; slot < first_slot; slot++) {
+        gen_place(state, slot, prefix[slot]);
+    }
+}
+
+// Put the state back the way it was at some point in a search, from all of its tiles. The tiles
+// after `slot` are always EMPTY in a running search, and a finished search has backtracked to a
+// slot before `first_slot` (or -1). Returns false if the tiles aren't valid.
+bool gen_restore(GenState *state, const Tile *tiles, i32 slot, i32 first_slot, i32 end_slot,
+                 bool found) {
+    if (first_slot < 0 || first_slot >= end_slot || end_slot > 64 || slot < -1 ||
+        slot >= end_slot) {
+        return false;
+    }
+    gen_init(state, tiles, first_slot, end_slot);
+    for (i32 s = first_slot; s < 64; s++) {
+        if (tiles[s] > TREASURE || (s > slot && tiles[s] != EMPTY)) {
+            return false;
+        }
+        gen_place(state, s, tiles[s]);
+    }
+    state->slot = slot;
+    state->found = found;
+    return true;
+}
+
+// Backtrack to the last set slot (which could be this one). A slot is set if it has any tile other
+// than EMPTY.
+void gen_backtrack(GenState *state) {
+    u64 set = state->solution | state->puzzle.monsters | state->puzzle.treasures;
+    i32 from_slot = state->slot;
+    state->slot = last_set_slot(set, state->slot);
+    STATS_BACKTRACK(state->stats ? &state->stats->search : NULL, from_slot, state->slot);
+}
+
+TileBoards gen_tiles(const GenState *state) {
+    return (TileBoards){.walls = state->solution,
+                        .monsters = state->puzzle.monsters,
+                        .treasures = state->puzzle.treasures};
+}
+
+// Checked whenever a row is finished. Every symmetry moves some of the finished cells to the start
+// of the board (mirroring keeps the rows, transposing turns the first column into the first row),
+// and if that part of a symmetry is already greater than the same part of the board, the board
+// can't be canonical whatever comes after. The last row checks the whole board.
+bool gen_could_be_canonical(const GenState *state, i32 slot) {
+    if (slot % 8 != 7) {
+        return true;
+    }
+    u64 placed = ~(u64)0 << (63 - slot);
+    TileBoards board = tiles_mask(gen_tiles(state), placed);
+    for (i32 symmetry = 1; symmetry < NUM_SYMMETRIES; symmetry++) {
+        // The slots before the first one that isn't placed in both boards.
+        u64 unknown = ~(board_transform(placed, symmetry) & placed);
+        u64 known = unknown ? ~(~(u64)0 >> first_set_slot(unknown)) : ~(u64)0;
+        if (known && tiles_greater(tiles_mask(tiles_transform(board, symmetry), known),
+                                   tiles_mask(board, known))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Search for the next valid board. Returns false when there are no more.
+// Uses a similar strategy to the solver, searches through the puzzle space for valid puzzles.
+// Puzzle space here is an empty tile, a wall, a monster or a treasure for every slot.
+bool gen_next(GenState *state) {
+    if (state->found) {
+        // Backtrack from the last board so we don't find it again.
+        state->found = false;
+        gen_backtrack(state);
+    }
+
+    Puzzle *puzzle = &state->puzzle;
+    SolveStats *stats = state->stats ? &state->stats->search : NULL;
+    while (state->first_slot <= state->slot && state->slot < state->end_slot) {
+        i32 slot = state->slot;
+        // Undo previous tile and choose next option.
+        switch (state->puzzle_tiles[slot]) {
+        case TREASURE: {
+            state->puzzle_tiles[slot] = MONSTER;
+            puzzle->treasures = slot_unset(puzzle->treasures, slot);
+            puzzle->monsters = slot_set(puzzle->monsters, slot);
+        } break;
+        case MONSTER: {
+            state->puzzle_tiles[slot] = WALL;
+            puzzle->monsters = slot_unset(puzzle->monsters, slot);
+            state->solution = slot_set(state->solution, slot);
+            wall_counts_set(&state->counts, slot);
+        } break;
+        case WALL: {
+            state->puzzle_tiles[slot] = EMPTY;
+            state->solution = slot_unset(state->solution, slot);
+            wall_counts_unset(&state->counts, slot);
+        } break;
+        case EMPTY: {
+            state->puzzle_tiles[slot] = TREASURE;
+            puzzle->treasures = slot_set(puzzle->treasures, slot);
+        } break;
+        }
+
+        u64 solution = state->solution;
+        STATS_NODE(stats, slot + 1);
+
+        // Check constraints.
+        if (run_generate_checks(state->checks, *puzzle, &state->counts, solution, slot, stats) &&
+            (state->all_symmetries || gen_could_be_canonical(state, slot))) {
+
+            // Move on to the next slot.
+            if (slot < state->end_slot - 1) {
+                state->slot++;
+                continue;
+            }
+
+            // This is a valid board!
+            // Stop here, the next call backtracks from it and keeps searching for more.
+            state->found = true;
+            return true;
+        }
+
+        gen_backtrack(state);
+    }
+    return false;
+}
+
+// The puzzle of the valid board the generator stopped at, without solving it.
+// The row and col counts are simply derived from the board.
+Puzzle gen_board_puzzle(const GenState *state) {
+    assert(state->found);
+    assert(state->end_slot == 64);
+    Puzzle valid_puzzle = {.row_wall_counts = {0, 0, 0, 0, 0, 0, 0},
+                           .col_wall_counts = {0, 0, 0, 0, 0, 0, 0},
+                           .monsters = state->puzzle.monsters,
+                           .treasures = state->puzzle.treasures};
+    // The row and col counts are the running counts of the walls we placed.
+    for (i32 i = 0; i < 8; i++) {
+        valid_puzzle.row_wall_counts[i] = state->counts.row_walls[i];
+        valid_puzzle.col_wall_counts[i] = state->counts.col_walls[i];
+    }
+    return valid_puzzle;
+}
+
+// Turn the valid board the generator stopped at into a puzzle, and count its solutions.
+GeneratedPuzzle gen_puzzle(const GenState *state) {
+    u64 solution = state->solution;
+    Puzzle valid_puzzle = gen_board_puzzle(state);
+    // Check number of solutions, all we need to know is whether it's unique.
+    u64 valid_puzzle_solutions[2];
+    SolveStats *stats = state->stats ? &state->stats->solve : NULL;
+    SolveResult solved =
+        state->cache
+            ? solve_cached(state->cache, valid_puzzle, valid_puzzle_solutions, 2, SOLVE_UNIQUE)
+            : solve_with_stats(valid_puzzle, valid_puzzle_solutions, 2, SOLVE_UNIQUE, NULL, stats);
+    u64 num_valid_puzzle_solutions = solved.num_solutions;
+
+#if 0
+    // @note(steve): Good place to debug stuff. For example this code looks at puzzles with more than one solution.
+    if (num_valid_puzzle_solutions != 1) {
+        printf("found puzzle with %" PRIu64 " solutions\n", num_valid_puzzle_solutions);
+        printf("Generated Solution\n");
+        print_puzzle(valid_puzzle, solution);
+        printf("Solver Solution 0\n");
+        print_puzzle(valid_puzzle, valid_puzzle_solutions[0]);
+        printf("Solver Solution 1\n");
+        print_puzzle(valid_puzzle, valid_puzzle_solutions[1]);
+    }
+#endif
+
+    return (GeneratedPuzzle){.puzzle = valid_puzzle,
+                             .solution = solution,
+                             .num_solutions = num_valid_puzzle_solutions};
+}
+
+// `generate`, running the search's checks in the order in `checks` (NULL for the default order) and
+// adding what the generator's search and its solves did to `stats` (which can be NULL) in
+// DANDD_STATS builds.
+u64 generate_with_stats(GeneratedPuzzle *puzzles, u64 max_puzzles, const CheckPipeline *checks,
+                        GenerateStats *stats) {
+    u64 puzzle_i = 0;
+    GenState state;
+    gen_init(&state, NULL, 0, 64);
+    state.checks = checks;
+    state.stats = stats;
+    // @note(Steve): Just stopping when the buffer is full, I haven't tried generating or counting
+    // them all.
+    while (puzzle_i < max_puzzles && gen_next(&state)) {
+        puzzles[puzzle_i++] = gen_puzzle(&state);
+    }
+    return puzzle_i;
+}
+
+// Generate valid puzzles.
+// Pushes all found puzzles into the passed in `puzzles` pointer which is assumed to
+// be an empty array with length max_puzzles.
+// Returns the number of puzzles found.
+// The row and col counts are simply derived from a valid puzzle.
+// This means there are 4^64 elements in puzzle space, which is much larger than the solution space
+// for a specific puzzle, though obviously most of them are not valid.
+u64 generate(GeneratedPuzzle *puzzles, u64 max_puzzles) {
+    return generate_with_stats(puzzles, max_puzzles, NULL, NULL);
+}
+
+// Call `on_puzzle` with every valid puzzle, in the same order as `generate`, until it returns
+// false. Uses the same memory no matter how many puzzles there are, so it can stream them out.
+// Returns the number of puzzles passed to `on_puzzle`. To pause and resume, use a GenState with
+// `gen_next` and `gen_puzzle` directly.
+u64 generate_each(GeneratedPuzzleFn on_puzzle, void *userdata) {
+    u64 puzzle_i = 0;
+    GenState state;
+    gen_init(&state, NULL, 0, 64);
+    while (gen_next(&state)) {
+        puzzle_i++;
+        if (!on_puzzle(userdata, gen_puzzle(&state))) {
+            break;
+        }
+    }
+    return puzzle_i;
+}
+
+// A generated puzzle with its difficulty score.
+typedef struct {
+    GeneratedPuzzle generated;
+    PuzzleScore score;
+} ScoredPuzzle;
+
+// Turn the valid board the generator stopped at into a puzzle and score it. The scoring search
+// also counts the solutions, so it takes the place of `gen_puzzle`'s solve.
+ScoredPuzzle gen_scored_puzzle(const GenState *state) {
+    ScoredPuzzle scored = {.generated = {.puzzle = gen_board_puzzle(state),
+                                         .solution = state->solution}};
+    scored.score = score_puzzle(scored.generated.puzzle, &scored.generated.num_solutions);
+    return scored;
+}
+
+// `generate`, scoring every puzzle and keeping the ones with a score in `range`. Use
+// `score_range_all` to keep them all.
+u64 generate_scored(ScoredPuzzle *puzzles, u64 max_puzzles, const ScoreRange *range) {
+    u64 puzzle_i = 0;
+    GenState state;
+    gen_init(&state, NULL, 0, 64);
+    while (puzzle_i < max_puzzles && gen_next(&state)) {
+        ScoredPuzzle scored = gen_scored_puzzle(&state);
+        if (score_in_range(scored.score, range)) {
+            puzzles[puzzle_i++] = scored;
+        }
+    }
+    return puzzle_i;
+}
+
+// A small fast PRNG (xoshiro256**) for the random generator, so that a run can be repeated from
+// its seed on any platform.
+typedef struct {
+    u64 state[4];
+} Rng;
+
+// Spread a 64 bit seed over the whole state with splitmix64, which also keeps the state from
+// being all zeros.
+Rng rng_seed(u64 seed) {
+    Rng rng;
+    for (i32 i = 0; i < 4; i++) {
+        seed += 0x9e3779b97f4a7c15;
+        rng.state[i] = mix_u64(seed);
+    }
+    return rng;
+}
+
+u64 rotl_u64(u64 x, i32 k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+u64 rng_next(Rng *rng) {
+    u64 *s = rng->state;
+    u64 result = rotl_u64(s[1] * 5, 7) * 9;
+    u64 t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl_u64(s[3], 45);
+    return result;
+}
+
+// A number in [0, n), n has to be small. Uses the high bits which are the best ones.
+u32 rng_below(Rng *rng, u32 n) {
+    return (u32)(((rng_next(rng) >> 32) * n) >> 32);
+}
+
+// How many tiles the random search places before it gives up on a start and restarts.
+#define GENERATE_RANDOM_BUDGET 256
+// How likely each tile is to be tried first, by EMPTY, WALL, MONSTER and TREASURE. Walls can go
+// nearly anywhere, so without the weights most boards would be one small corridor and all walls.
+#define RANDOM_TILE_WEIGHTS 10, 6, 1, 1
+// How many restarts per puzzle before `generate_random` gives up, so it always returns.
+#define GENERATE_RANDOM_MAX_RESTARTS 4096
+
+// A depth first search like `gen_next` where every slot tries the tiles in its own random order.
+// The search is cut off after a budget of placed tiles and starts over with new orders, so a bad
+// choice near the top of the board doesn't sink the rest of the run.
+typedef struct {
+    GenState gen;
+    Rng rng;
+    // The order each slot tries its tiles in, drawn when the search moves onto the slot.
+    Tile orders[64][4];
+    // How many tiles of its order each slot has tried.
+    u8 tried[64];
+    // Placed tiles left before the next restart.
+    u64 budget;
+} RandomGenState;
+
+void random_gen_restart(RandomGenState *state) {
+    gen_init(&state->gen, NULL, 0, 64);
+    state->gen.all_symmetries = true;
+    state->budget = GENERATE_RANDOM_BUDGET;
+}
+
+void random_gen_enter(RandomGenState *state, i32 slot) {
+    // Draw the tiles one at a time without replacement, each with its weight.
+    u32 weights[4] = {RANDOM_TILE_WEIGHTS};
+    u32 total = weights[EMPTY] + weights[WALL] + weights[MONSTER] + weights[TREASURE];
+    for (i32 i = 0; i < 4; i++) {
+        u32 pick = rng_below(&state->rng, total);
+        u32 tile = 0;
+        while (pick >= weights[tile]) {
+            pick -= weights[tile];
+            tile++;
+        }
+        state->orders[slot][i] = (Tile)tile;
+        total -= weights[tile];
+        weights[tile] = 0;
+    }
+    state->tried[slot] = 0;
+}
+
+void random_gen_init(RandomGenState *state, u64 seed) {
+    state->rng = rng_seed(seed);
+    random_gen_restart(state);
+    random_gen_enter(state, 0);
+}
+
+// Find the next valid board, which `gen_puzzle(&state->gen)` turns into a puzzle. Returns false if
+// the budget ran out first, the next call restarts. Never allocates.
+bool random_gen_next(RandomGenState *state) {
+    GenState *gen = &state->gen;
+    if (gen->found) {
+        gen->found = false;
+        gen_unplace(gen, gen->slot);
+    }
+    if (state->budget == 0) {
+        random_gen_restart(state);
+        random_gen_enter(state, 0);
+    }
+
+    SolveStats *stats = gen->stats ? &gen->stats->search : NULL;
+    while (state->budget > 0) {
+        i32 slot = gen->slot;
+        if (state->tried[slot] == 4) {
+            // Every tile failed here, and at slot 0 there are no boards left at all.
+            if (slot == 0) {
+                state->budget = 0;
+                break;
+            }
+            gen->slot--;
+            gen_unplace(gen, gen->slot);
+            continue;
+        }
+
+        gen_place(gen, slot, state->orders[slot][state->tried[slot]++]);
+        state->budget--;
+        STATS_NODE(stats, slot + 1);
+        if (run_generate_checks(gen->checks, gen->puzzle, &gen->counts, gen->solution, slot,
+                                stats)) {
+            if (slot == 63) {
+                gen->found = true;
+                return true;
+            }
+            gen->slot++;
+            random_gen_enter(state, gen->slot);
+            continue;
+        }
+        gen_unplace(gen, slot);
+    }
+    return false;
+}
+
+// Generate up to `max_puzzles` random unique puzzles from `seed`. The same seed always gives the
+// same puzzles. Boards with more than one solution are rejected and the search carries on from
+// them, which usually only has to change the last few tiles to find another board. Unlike
+// `generate` the puzzles come in any orientation and the same puzzle can come up more than once.
+// Returns the number of puzzles found, which is only short of `max_puzzles` if it had to give up.
+u64 generate_random(GeneratedPuzzle *puzzles, u64 max_puzzles, u64 seed) {
+    RandomGenState state;
+    random_gen_init(&state, seed);
+    u64 puzzle_i = 0;
+    u64 restarts = 0;
+    while (puzzle_i < max_puzzles) {
+        if (!random_gen_next(&state)) {
+            if (++restarts == GENERATE_RANDOM_MAX_RESTARTS) {
+                break;
+            }
+            continue;
+        }
+        GeneratedPuzzle generated = gen_puzzle(&state.gen);
+        if (generated.num_solutions == 1) {
+            puzzles[puzzle_i++] = generated;
+            restarts = 0;
+            // Start the next puzzle from scratch, boards found right after this one share most of
+            // its tiles.
+            state.budget = 0;
+        }
+    }
+    return puzzle_i;
+}
+
+// Most of a puzzle follows from its walls: every dead end has to be a monster, and every treasure
+// room needs a treasure somewhere inside it. So the walls first generator only searches the wall
+// layouts, two options per slot instead of four, and derives everything else from each layout
+// that it finishes. A layout with rooms gives a puzzle for every way of putting a treasure in each
+// of them.
+
+// The most treasure rooms (with the walls around them) that fit on a board.
+#define WALL_GEN_MAX_ROOMS 4
+
+// The state of the walls first search over the slots from `first_slot` on. Like a `GenState` it
+// can stop at every valid puzzle and pick back up from there.
+typedef struct {
+    // The walls placed so far, and every slot that's been set to a wall or left open.
+    u64 walls;
+    u64 placed;
+    i32 slot;
+    i32 first_slot;
+    // The puzzle of the finished layout the search has stopped at.
+    Puzzle puzzle;
+    // The centers of its rooms, and which of the 9 cells of each room has the treasure.
+    i32 room_centers[WALL_GEN_MAX_ROOMS];
+    i32 treasure_cells[WALL_GEN_MAX_ROOMS];
+    i32 num_rooms;
+    // Set when the state is stopped at a valid puzzle.
+    bool found;
+    // The search only finds one puzzle of each set of symmetric ones unless this is set, see
+    // `wall_gen_could_be_canonical`.
+    bool all_symmetries;
+    // Where to count what the search does in DANDD_STATS builds, can be NULL.
+    GenerateStats *stats;
+} WallGenState;
+
+// Start a search with the slots before `first_slot` fixed to the walls in `walls`.
+void wall_gen_init(WallGenState *state, u64 walls, i32 first_slot) {
+    assert(0 <= first_slot && first_slot < 64);
+    init_masks();
+    u64 fixed = first_slot ? ~(u64)0 << (64 - first_slot) : 0;
+    *state = (WallGenState){
+        .walls = walls & fixed, .placed = fixed, .slot = first_slot, .first_slot = first_slot};
+}
+
+// The checks that only need walls, for the cells that get all of their neighbors at this slot and
+// the 2x2 space that ends at it.
+bool wall_gen_check(u64 walls, i32 slot) {
+    u64 placed = ~(u64)0 << (63 - slot);
+    u64 open = ~walls & placed;
+
+    // An open cell with no open neighbors can't be a monster, and it isn't in a treasure room.
+    u64 finished = slot >= 8 ? slot_set(0, slot - 8) : 0;
+    if (slot >= 56 && slot % 8 != 0) {
+        finished = slot_set(finished, slot - 1);
+    }
+    if (slot == 63) {
+        finished = slot_set(finished, slot);
+    }
+    if (finished & open & ~board_neighbors(open)) {
+        return false;
+    }
+
+    // A 2x2 space can only be inside a treasure room, so one of the rooms around it still has to
+    // be possible: no walls inside, and at most one way in so far.
+    u64 space = masks.wide_space[slot];
+    if (space && !(space & ~open)) {
+        u64 centers = masks.rooms_containing[slot] & masks.rooms_containing[slot - 9];
+        bool possible = false;
+        while (centers && !possible) {
+            i32 center = first_set_slot(centers);
+            centers = slot_unset(centers, center);
+            possible = !(masks.room[center] & walls) &&
+                       count_set_bits(masks.room_walls[center] & open) <= 1;
+        }
+        if (!possible) {
+            return false;
+        }
+    }
+
+    return check_connected(walls, slot);
+}
+
+// The walls first search picks its own puzzle out of every set of symmetric ones: the one with the
+// greatest walls (as a number, so walls at the start count the most), and out of those the one that
+// `is_canonical` would pick. The walls alone decide it for most layouts, so like
+// `gen_could_be_canonical` it's checked when each row is finished, on the slots known in both.
+bool wall_gen_could_be_canonical(u64 walls, i32 slot) {
+    if (slot % 8 != 7) {
+        return true;
+    }
+    u64 placed = ~(u64)0 << (63 - slot);
+    for (i32 symmetry = 1; symmetry < NUM_SYMMETRIES; symmetry++) {
+        u64 unknown = ~(board_transform(placed, symmetry) & placed);
+        u64 known = unknown ? ~(~(u64)0 >> first_set_slot(unknown)) : ~(u64)0;
+        if ((board_transform(walls, symmetry) & known) > (walls & known)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The full check for a finished puzzle, with the symmetries of the layout that have the same walls.
+bool wall_gen_is_canonical(TileBoards board) {
+    for (i32 symmetry = 1; symmetry < NUM_SYMMETRIES; symmetry++) {
+        TileBoards image = tiles_transform(board, symmetry);
+        if (image.walls > board.walls ||
+            (image.walls == board.walls && tiles_greater(image, board))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Derive the monsters, rooms and wall counts of the finished layout, with the treasures in the
+// first cell of each room. Returns false if the layout can't make a valid puzzle.
+bool wall_gen_layout(WallGenState *state) {
+    u64 walls = state->walls;
+    u64 open = ~walls;
+    Puzzle *puzzle = &state->puzzle;
+    puzzle->monsters = open & board_one_open_neighbor(open);
+
+    // Every 2x2 space has to be in a room, and every room has a 2x2 space.
+    u64 columns = open & board_from_above(open);
+    u64 spaces = columns & board_from_left(columns);
+    u64 rooms = 0;
+    while (spaces) {
+        i32 corner = first_set_slot(spaces);
+        spaces = slot_unset(spaces, corner);
+        u64 centers = masks.rooms_containing[corner] & masks.rooms_containing[corner - 9];
+        u64 room = 0;
+        while (centers && !room) {
+            i32 center = first_set_slot(centers);
+            centers = slot_unset(centers, center);
+            if (!(masks.room[center] & walls) &&
+                count_set_bits(masks.room_walls[center] & open) == 1) {
+                room = slot_set(0, center);
+            }
+        }
+        if (!room) {
+            return false;
+        }
+        rooms |= room;
+    }
+    // More rooms than fit on the board would have to overlap, which isn't a valid layout.
+    if (count_set_bits(rooms) > WALL_GEN_MAX_ROOMS) {
+        return false;
+    }
+    state->num_rooms = 0;
+    while (rooms) {
+        i32 center = first_set_slot(rooms);
+        rooms = slot_unset(rooms, center);
+        state->room_centers[state->num_rooms] = center;
+        state->treasure_cells[state->num_rooms++] = 0;
+    }
+
+    u64 transposed = board_transpose(walls);
+    for (i32 i = 0; i < 8; i++) {
+        puzzle->row_wall_counts[i] = (u8)count_set_bits((walls >> (56 - 8 * i)) & 0xff);
+        puzzle->col_wall_counts[i] = (u8)count_set_bits((transposed >> (56 - 8 * i)) & 0xff);
+    }
+    return true;
+}
+
+// Move the treasures to their next cells, counting through the cells of the last room first.
+// Returns false once every placement has been tried.
+bool wall_gen_next_treasures(WallGenState *state) {
+    for (i32 i = state->num_rooms - 1; i >= 0; i--) {
+        if (++state->treasure_cells[i] < 9) {
+            return true;
+        }
+        state->treasure_cells[i] = 0;
+    }
+    return false;
+}
+
+// Put the treasures in their cells and check the whole puzzle, which catches the rules the walls
+// alone can't (like a monster next to a treasure).
+bool wall_gen_puzzle_is_valid(WallGenState *state) {
+    u64 treasures = 0;
+    for (i32 i = 0; i < state->num_rooms; i++) {
+        i32 cell = state->treasure_cells[i];
+        treasures = slot_set(treasures, state->room_centers[i] - 9 + (cell / 3) * 8 + cell % 3);
+    }
+    state->puzzle.treasures = treasures;
+    if (!validate_solution(&state->puzzle, state->walls)) {
+        return false;
+    }
+    TileBoards tiles = {
+        .walls = state->walls, .monsters = state->puzzle.monsters, .treasures = treasures};
+    return state->all_symmetries || wall_gen_is_canonical(tiles);
+}
+
+// Find the next valid puzzle, which `wall_gen_puzzle` then counts the solutions of. Returns false
+// when there aren't any more.
+bool wall_gen_next(WallGenState *state) {
+    if (state->found) {
+        // The other treasure placements of the same layout come first.
+        state->found = false;
+        while (wall_gen_next_treasures(state)) {
+            if (wall_gen_puzzle_is_valid(state)) {
+                state->found = true;
+                return true;
+            }
+        }
+    }
+
+    SolveStats *stats = state->stats ? &state->stats->search : NULL;
+    while (state->first_slot <= state->slot && state->slot < 64) {
+        i32 slot = state->slot;
+        // Try a wall first, then leave the slot open, then go back to the slot before.
+        if (!slot_is_set(state->placed, slot)) {
+            state->placed = slot_set(state->placed, slot);
+            state->walls = slot_set(state->walls, slot);
+        } else if (slot_is_set(state->walls, slot)) {
+            state->walls = slot_unset(state->walls, slot);
+        } else {
+            state->placed = slot_unset(state->placed, slot);
+            state->slot--;
+            STATS_BACKTRACK(stats, slot, state->slot);
+            continue;
+        }
+        STATS_NODE(stats, slot + 1);
+
+        if (!wall_gen_check(state->walls, slot) ||
+            !(state->all_symmetries || wall_gen_could_be_canonical(state->walls, slot))) {
+            continue;
+        }
+        if (slot < 63) {
+            state->slot++;
+            continue;
+        }
+        if (wall_gen_layout(state)) {
+            do {
+                if (wall_gen_puzzle_is_valid(state)) {
+                    state->found = true;
+                    return true;
+                }
+            } while (wall_gen_next_treasures(state));
+        }
+    }
+    return false;
+}
+
+// Count the solutions of the puzzle the search stopped at, like `gen_puzzle`.
+GeneratedPuzzle wall_gen_puzzle(const WallGenState *state) {
+    assert(state->found);
+    u64 solutions[2];
+    SolveStats *stats = state->stats ? &state->stats->solve : NULL;
+    SolveResult solved =
+        solve_with_stats(state->puzzle, solutions, 2, SOLVE_UNIQUE, NULL, stats);
+    return (GeneratedPuzzle){.puzzle = state->puzzle,
+                             .solution = state->walls,
+                             .num_solutions = solved.num_solutions};
+}
+
+// `generate` with the walls first search. It finds the same puzzles up to symmetry, in a different
+// order and not always in the same orientation.
+u64 generate_walls(GeneratedPuzzle *puzzles, u64 max_puzzles) {
+    u64 puzzle_i = 0;
+    WallGenState state;
+    wall_gen_init(&state, 0, 0);
+    while (puzzle_i < max_puzzles && wall_gen_next(&state)) {
+        puzzles[puzzle_i++] = wall_gen_puzzle(&state);
+    }
+    return puzzle_i;
+}
+
+// `generate_each` with the walls first search.
+u64 generate_walls_each(GeneratedPuzzleFn on_puzzle, void *userdata) {
+    u64 puzzle_i = 0;
+    WallGenState state;
+    wall_gen_init(&state, 0, 0);
+    while (wall_gen_next(&state)) {
+        puzzle_i++;
+        if (!on_puzzle(userdata, wall_gen_puzzle(&state))) {
+            break;
+        }
+    }
+    return puzzle_i;
+}
+
+// A bounded lock-free queue of generated (and maybe scored) puzzles with many producers and a
+// single consumer. Producers claim a cell by bumping `head`, fill it in and then publish it by
+// bumping the cell's sequence number. The consumer reads cells in order at `tail`, once they've
+// been published.
+typedef struct {
+    u64 sequence;
+    ScoredPuzzle puzzle;
+} PuzzleRingCell;
+
+typedef struct {
+    PuzzleRingCell *cells;
+    u64 mask;
+    // Producers and the consumer hit these constantly, keep them on separate cache lines.
+    u8 pad0[64];
+    u64 head;
+    u8 pad1[64];
+    u64 tail;
+} PuzzleRing;
+
+// `capacity` must be a power of 2.
+bool puzzle_ring_init(PuzzleRing *ring, u64 capacity) {
+    assert(capacity && !(capacity & (capacity - 1)));
+    *ring = (PuzzleRing){0};
+    ring->cells = malloc(sizeof(PuzzleRingCell) * capacity);
+    if (!ring->cells) {
+        return false;
+    }
+    ring->mask = capacity - 1;
+    for (u64 i = 0; i < capacity; i++) {
+        ring->cells[i].sequence = i;
+    }
+    return true;
+}
+
+void puzzle_ring_free(PuzzleRing *ring) {
+    free(ring->cells);
+    *ring = (PuzzleRing){0};
+}
+
+// Returns false if the ring is full. Safe to call from any number of threads.
+bool puzzle_ring_push(PuzzleRing *ring, ScoredPuzzle puzzle) {
+    u64 pos = atomic_load_u64(&ring->head);
+    for (;;) {
+        PuzzleRingCell *cell = &ring->cells[pos & ring->mask];
+        i64 diff = (i64)(atomic_load_u64(&cell->sequence) - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_u64(&ring->head, &pos, pos + 1)) {
+                cell->puzzle = puzzle;
+                atomic_store_u64(&cell->sequence, pos + 1);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_u64(&ring->head);
+        }
+    }
+}
+
+// Returns false if the ring is empty. Only the consumer thread can call this.
+bool puzzle_ring_pop(PuzzleRing *ring, ScoredPuzzle *puzzle) {
+    PuzzleRingCell *cell = &ring->cells[ring->tail & ring->mask];
+    if (atomic_load_u64(&cell->sequence) != ring->tail + 1) {
+        return false;
+    }
+    *puzzle = cell->puzzle;
+    atomic_store_u64(&cell->sequence, ring->tail + ring->mask + 1);
+    ring->tail++;
+    return true;
+}
+
+// Parallel generator.
+// Splits the puzzle space up by the tiles in the first few slots. Every valid prefix is a task
+// that runs its own generator search (and solves) over the rest of the slots on a worker thread.
+// Generated puzzles go through a ring to the calling thread, which copies them out until it has
+// enough and then tells the workers to stop. When they're scored, the workers score them too and
+// only push the ones in range, so scoring runs in parallel with the rest of the search.
+
+#define GENERATE_PREFIX_SLOTS 6
+
+typedef struct {
+    const Tile *prefixes;
+    PuzzleRing ring;
+    u64 stop;
+    u64 done;
+    i32 num_threads;
+    u64 num_prefixes;
+    // The scores to keep, or NULL to not score the puzzles.
+    const ScoreRange *range;
+    ThreadStart start;
+} GenerateParallel;
+
+void generate_task(void *context, u64 task, i32 worker) {
+    (void)worker;
+    GenerateParallel *parallel = context;
+    GenState state;
+    gen_init(&state, &parallel->prefixes[task * GENERATE_PREFIX_SLOTS], GENERATE_PREFIX_SLOTS, 64);
+    while (!atomic_load_u64(&parallel->stop) && gen_next(&state)) {
+        ScoredPuzzle puzzle;
+        if (parallel->range) {
+            puzzle = gen_scored_puzzle(&state);
+            if (!score_in_range(puzzle.score, parallel->range)) {
+                continue;
+            }
+        } else {
+            puzzle = (ScoredPuzzle){.generated = gen_puzzle(&state)};
+        }
+        while (!puzzle_ring_push(&parallel->ring, puzzle)) {
+            if (atomic_load_u64(&parallel->stop)) {
+                return;
+            }
+            thread_yield();
+        }
+    }
+}
+
+void generate_run_tasks(void *arg) {
+    GenerateParallel *parallel = arg;
+    if (!run_tasks(parallel->num_prefixes, parallel->num_threads, generate_task, parallel)) {
+        // Couldn't start the pool, run the tasks here instead.
+        for (u64 i = 0; i < parallel->num_prefixes && !atomic_load_u64(&parallel->stop); i++) {
+            generate_task(parallel, i, 0);
+        }
+    }
+    atomic_store_u64(&parallel->done, 1);
+}
+
+// Every valid arrangement of the first `depth` slots, in the order the generator finds them,
+// `depth` tiles each. Splits the puzzle space into parts that can be searched separately. Returns
+// NULL if out of memory, otherwise the caller frees it.
+Tile *generate_prefixes_to(i32 depth, u64 *num_prefixes) {
+    Tile *prefixes = NULL;
+    u64 prefixes_cap = 0;
+    *num_prefixes = 0;
+    GenState state;
+    gen_init(&state, NULL, 0, depth);
+    while (gen_next(&state)) {
+        if (*num_prefixes == prefixes_cap) {
+            prefixes_cap = prefixes_cap ? prefixes_cap * 2 : 256;
+            Tile *grown = realloc(prefixes, sizeof(Tile) * (u64)depth * prefixes_cap);
+            if (!grown) {
+                free(prefixes);
+                return NULL;
+            }
+            prefixes = grown;
+        }
+        for (i32 i = 0; i < depth; i++) {
+            prefixes[*num_prefixes * (u64)depth + (u64)i] = state.puzzle_tiles[i];
+        }
+        (*num_prefixes)++;
+    }
+    return prefixes;
+}
+
+Tile *generate_prefixes(u64 *num_prefixes) {
+    return generate_prefixes_to(GENERATE_PREFIX_SLOTS, num_prefixes);
+}
+
+typedef bool (*ScoredPuzzleFn)(void *userdata, ScoredPuzzle puzzle);
+
+// Runs the parallel generator for `generate_parallel`, `generate_scored_parallel` and
+// `generate_parallel_each`, calling `on_puzzle` on this thread with each puzzle until it returns
+// false. Returns the number of puzzles it was called with, or UINT64_MAX if the workers couldn't
+// be started, and the caller should generate on this thread instead.
+u64 generate_parallel_with(ScoredPuzzleFn on_puzzle, void *userdata, i32 num_threads,
+                           const ScoreRange *range) {
+    u64 num_prefixes;
+    Tile *prefixes = generate_prefixes(&num_prefixes);
+    if (!prefixes) {
+        return UINT64_MAX;
+    }
+
+    GenerateParallel context = {.prefixes = prefixes,
+                                .num_threads = num_threads,
+                                .num_prefixes = num_prefixes,
+                                .range = range};
+    context.start = (ThreadStart){.fn = generate_run_tasks, .arg = &context};
+    Thread runner;
+    if (!puzzle_ring_init(&context.ring, 1024)) {
+        free(prefixes);
+        return UINT64_MAX;
+    }
+    if (!thread_start(&runner, &context.start)) {
+        puzzle_ring_free(&context.ring);
+        free(prefixes);
+        return UINT64_MAX;
+    }
+
+    u64 puzzle_i = 0;
+    ScoredPuzzle puzzle;
+    while (true) {
+        // Everything was pushed before done was set, so if the ring is still empty after it's set
+        // we're finished.
+        bool done = atomic_load_u64(&context.done);
+        if (puzzle_ring_pop(&context.ring, &puzzle)) {
+            puzzle_i++;
+            if (!on_puzzle(userdata, puzzle)) {
+                break;
+            }
+        } else if (done) {
+            break;
+        } else {
+            thread_yield();
+        }
+    }
+    atomic_store_u64(&context.stop, 1);
+    thread_join(runner);
+
+    puzzle_ring_free(&context.ring);
+    free(prefixes);
+    return puzzle_i;
+}
+
+// Copies puzzles out to `scored` if it's set, otherwise to `puzzles`, until there are max of them.
+typedef struct {
+    GeneratedPuzzle *puzzles;
+    ScoredPuzzle *scored;
+    u64 len;
+    u64 max;
+} PuzzleCollector;
+
+bool collect_puzzle(void *userdata, ScoredPuzzle puzzle) {
+    PuzzleCollector *collector = userdata;
+    if (collector->scored) {
+        collector->scored[collector->len++] = puzzle;
+    } else {
+        collector->puzzles[collector->len++] = puzzle.generated;
+    }
+    return collector->len < collector->max;
+}
+
+// Generate valid puzzles using `num_threads` worker threads. Takes the same arguments as
+// `generate`, but which puzzles come back, and in what order, depends on how the threads run.
+u64 generate_parallel(GeneratedPuzzle *puzzles, u64 max_puzzles, i32 num_threads) {
+    PuzzleCollector collector = {.puzzles = puzzles, .max = max_puzzles};
+    u64 num_puzzles = num_threads > 1 && max_puzzles > 0
+                          ? generate_parallel_with(collect_puzzle, &collector, num_threads, NULL)
+                          : UINT64_MAX;
+    return num_puzzles == UINT64_MAX ? generate(puzzles, max_puzzles) : num_puzzles;
+}
+
+// `generate_scored` using `num_threads` worker threads. Every puzzle is scored on the thread that
+// generated it.
+u64 generate_scored_parallel(ScoredPuzzle *puzzles, u64 max_puzzles, const ScoreRange *range,
+                             i32 num_threads) {
+    PuzzleCollector collector = {.scored = puzzles, .max = max_puzzles};
+    u64 num_puzzles = num_threads > 1 && max_puzzles > 0
+                          ? generate_parallel_with(collect_puzzle, &collector, num_threads, range)
+                          : UINT64_MAX;
+    return num_puzzles == UINT64_MAX ? generate_scored(puzzles, max_puzzles, range) : num_puzzles;
+}
+
+typedef struct {
+    GeneratedPuzzleFn on_puzzle;
+    void *userdata;
+} PuzzleFnArgs;
+
+bool call_puzzle_fn(void *userdata, ScoredPuzzle puzzle) {
+    PuzzleFnArgs *args = userdata;
+    return args->on_puzzle(args->userdata, puzzle.generated);
+}
+
+// `generate_each` using `num_threads` worker threads, `on_puzzle` is always called on this thread.
+// Like `generate_parallel` the order depends on how the threads run.
+u64 generate_parallel_each(GeneratedPuzzleFn on_puzzle, void *userdata, i32 num_threads) {
+    PuzzleFnArgs args = {.on_puzzle = on_puzzle, .userdata = userdata};
+    u64 num_puzzles = num_threads > 1
+                          ? generate_parallel_with(call_puzzle_fn, &args, num_threads, NULL)
+                          : UINT64_MAX;
+    return num_puzzles == UINT64_MAX ? generate_each(on_puzzle, userdata) : num_puzzles;
+}
+
+// Arenas.
+// Results that can be any size go at the top of an arena the caller hands over, one after the
+// other, so they can keep growing until the arena is full instead of stopping at a fixed
+// max_solutions or max_puzzles. Nothing in them is freed on its own, `arena_reset` frees it all.
+
+Arena arena_init(void *memory, u64 size) {
+    return (Arena){.memory = memory, .size = size};
+}
+
+// Allocate `size` bytes, 8 byte aligned. Returns NULL and sets `full` if they don't fit. Back to
+// back allocations of a multiple of 8 bytes are contiguous.
+void *arena_alloc(Arena *arena, u64 size) {
+    u64 misaligned = (u64)(uintptr_t)(arena->memory + arena->used) & 7;
+    u64 start = arena->used + (misaligned ? 8 - misaligned : 0);
+    if (start > arena->size || size > arena->size - start) {
+        arena->full = true;
+        return NULL;
+    }
+    arena->used = start + size;
+    return arena->memory + start;
+}
+
+void arena_reset(Arena *arena) {
+    arena->used = 0;
+    arena->full = false;
+}
+
+typedef struct {
+    Arena *arena;
+    u64 *solutions;
+    u64 num_solutions;
+    u64 stop_after;
+} ArenaSolutions;
+
+bool arena_push_solution(void *userdata, u64 solution) {
+    ArenaSolutions *list = userdata;
+    u64 *slot = arena_alloc(list->arena, sizeof(u64));
+    if (!slot) {
+        return false;
+    }
+    if (!list->solutions) {
+        list->solutions = slot;
+    }
+    assert(slot == list->solutions + list->num_solutions);
+    *slot = solution;
+    list->num_solutions++;
+    return !list->stop_after || list->num_solutions < list->stop_after;
+}
+
+// Solve into the arena. The solutions are put in `*solutions` (NULL if there aren't any), in the
+// same order as `solve`, and all of them are recorded. If the arena fills up the search stops
+// there and `hit_max` is set, so there could be more.
+SolveResult solve_arena(Puzzle puzzle, SolveMode mode, Arena *arena, u64 **solutions) {
+    ArenaSolutions list = {.arena = arena, .stop_after = solve_mode_limit(mode)};
+    bool was_full = arena->full;
+    arena->full = false;
+    solve_each(puzzle, arena_push_solution, &list);
+    bool hit_max = arena->full;
+    arena->full = was_full || hit_max;
+    *solutions = list.solutions;
+    return (SolveResult){.num_solutions = list.num_solutions, .hit_max = hit_max};
+}
+
+// Generate up to `max_puzzles` puzzles (0 for no limit) into the arena, like `generate`. The
+// puzzles are put in `*puzzles` and the number of them is returned. If the arena fills up first,
+// `full` is set on it.
+u64 generate_arena(u64 max_puzzles, Arena *arena, GeneratedPuzzle **puzzles) {
+    *puzzles = NULL;
+    u64 puzzle_i = 0;
+    GenState state;
+    gen_init(&state, NULL, 0, 64);
+    while ((!max_puzzles || puzzle_i < max_puzzles) && gen_next(&state)) {
+        GeneratedPuzzle *slot = arena_alloc(arena, sizeof(GeneratedPuzzle));
+        if (!slot) {
+            break;
+        }
+        if (!*puzzles) {
+            *puzzles = slot;
+        }
+        assert(slot == *puzzles + puzzle_i);
+        *slot = gen_puzzle(&state);
+        puzzle_i++;
+    }
+    return puzzle_i;
+}
+
+// Monotonic time in nanoseconds.
+u64 now_ns(void) {
+#if defined(_WIN32)
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    u64 ticks = (u64)counter.QuadPart;
+    u64 per_second = (u64)frequency.QuadPart;
+    return ticks / per_second * 1000000000 + ticks % per_second * 1000000000 / per_second;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + (u64)ts.tv_nsec;
+#endif
+}
+
+// Reading and writing little endian numbers, for the files the program writes.
+
+void put_u32(u8 *bytes, u32 value) {
+    for (i32 i = 0; i < 4; i++) {
+        bytes[i] = (u8)(value >> (8 * i));
+    }
+}
+
+void put_u64(u8 *bytes, u64 value) {
+    for (i32 i = 0; i < 8; i++) {
+        bytes[i] = (u8)(value >> (8 * i));
+    }
+}
+
+u32 get_u32(const u8 *bytes) {
+    u32 value = 0;
+    for (i32 i = 0; i < 4; i++) {
+        value |= (u32)bytes[i] << (8 * i);
+    }
+    return value;
+}
+
+u64 get_u64(const u8 *bytes) {
+    u64 value = 0;
+    for (i32 i = 0; i < 8; i++) {
+        value |= (u64)bytes[i] << (8 * i);
+    }
+    return value;
+}
+
+#if !defined(DANDD_LIBRARY)
+// Parse a count from the command line. Returns false if it isn't a number or it's more than `max`.
+bool parse_count(const char *text, u64 max, u64 *count) {
+    char *end;
+    errno = 0;
+    *count = strtoull(text, &end, 10);
+    return end != text && *end == '\0' && text[0] != '-' && errno == 0 && *count <= max;
+}
+
+// Most threads a command will start.
+#define CLI_MAX_THREADS 1024
+
+// Parse `--threads`. Returns false unless it's from 1 to CLI_MAX_THREADS.
+bool parse_threads(const char *text, i32 *num_threads) {
+    u64 count;
+    if (!parse_count(text, CLI_MAX_THREADS, &count) || count == 0) {
+        return false;
+    }
+    *num_threads = (i32)count;
+    return true;
+}
+
+// Parse a number of seconds, like `--every`, into ns. Returns false unless it's at least 1 and the
+// ns fit in a u64.
+bool parse_seconds(const char *text, u64 *ns) {
+    u64 seconds;
+    if (!parse_count(text, UINT64_MAX / 1000000000, &seconds) || seconds == 0) {
+        return false;
+    }
+    *ns = seconds * 1000000000;
+    return true;
+}
+
+bool file_exists(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file) {
+        fclose(file);
+    }
+    return file != NULL;
+}
+
+// Full enumeration.
+// `dandd enumerate` generates every puzzle, which takes a very long time, so it's made to run as a
+// job that can be stopped and restarted. The puzzle space is split into work units, one for each
+// prefix from `generate_prefixes`, and every unit checkpoints its own generator state to a file in
+// the checkpoint directory. Completed units are never redone on resume, and a shard of the units
+// (`--shard i --shards n`) can be run on each machine.
+
+#define CHECKPOINT_MAGIC 0x444e4e44 // "DNND"
+#define CHECKPOINT_VERSION 4
+#define CHECKPOINT_SIZE 109
+#define ENUMERATE_DEFAULT_SECONDS 60
+
+// The state of a work unit, what's written to its checkpoint file.
+typedef struct {
+    u64 unit;
+    // How many puzzles the unit has generated so far and how many had a unique solution.
+    u64 num_puzzles;
+    u64 num_unique;
+    bool finished;
+    GenState state;
+} Checkpoint;
+
+// FNV-1a, to catch checkpoints that were only partly written. `hash_bytes_from` carries on
+// hashing from an earlier hash, for hashing a file a piece at a time.
+u64 hash_bytes_from(u64 hash, const u8 *bytes, u64 len) {
+    for (u64 i = 0; i < len; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+#define HASH_BYTES_START 0xcbf29ce484222325
+
+u64 hash_bytes(const u8 *bytes, u64 len) {
+    return hash_bytes_from(HASH_BYTES_START, bytes, len);
+}
+
+// The file layout, all little endian: magic, version, unit, num_puzzles, num_unique, finished,
+// found, slot, first_slot, end_slot, the 64 tiles and then a hash of everything before it.
+void checkpoint_encode(const Checkpoint *checkpoint, u8 *bytes) {
+    const GenState *state = &checkpoint->state;
+    put_u32(&bytes[0], CHECKPOINT_MAGIC);
+    put_u32(&bytes[4], CHECKPOINT_VERSION);
+    put_u64(&bytes[8], checkpoint->unit);
+    put_u64(&bytes[16], checkpoint->num_puzzles);
+    put_u64(&bytes[24], checkpoint->num_unique);
+    bytes[32] = checkpoint->finished;
+    bytes[33] = state->found;
+    bytes[34] = (u8)state->slot;
+    bytes[35] = (u8)state->first_slot;
+    bytes[36] = (u8)state->end_slot;
+    for (i32 i = 0; i < 64; i++) {
+        bytes[37 + i] = (u8)state->puzzle_tiles[i];
+    }
+    put_u64(&bytes[101], hash_bytes(bytes, 101));
+}
+
+bool checkpoint_decode(const u8 *bytes, Checkpoint *checkpoint) {
+    if (get_u32(&bytes[0]) != CHECKPOINT_MAGIC || get_u32(&bytes[4]) != CHECKPOINT_VERSION ||
+        get_u64(&bytes[101]) != hash_bytes(bytes, 101)) {
+        return false;
+    }
+    checkpoint->unit = get_u64(&bytes[8]);
+    checkpoint->num_puzzles = get_u64(&bytes[16]);
+    checkpoint->num_unique = get_u64(&bytes[24]);
+    checkpoint->finished = bytes[32] != 0;
+    Tile tiles[64];
+    for (i32 i = 0; i < 64; i++) {
+        tiles[i] = (Tile)bytes[37 + i];
+    }
+    // A finished search's slot can be -1, which is written as 0xff.
+    i32 slot = bytes[34] == 0xff ? -1 : bytes[34];
+    return gen_restore(&checkpoint->state, tiles, slot, bytes[35], bytes[36], bytes[33] != 0);
+}
+
+// Temporary files get the process id and a count in their names, so threads and processes writing
+// the same file don't write over each other's temporary file.
+static u64 temp_file_count;
+
+u64 process_id(void) {
+#if defined(_WIN32)
+    return (u64)_getpid();
+#else
+    return (u64)getpid();
+#endif
+}
+
+// Write `bytes` to a new temporary file next to `path`, whose name goes in `temp_path`. Returns
+// false (and leaves nothing behind) if it couldn't be written.
+bool write_temp_file(const char *path, const void *bytes, u64 len, char *temp_path,
+                     u64 temp_path_len) {
+    u64 count = atomic_fetch_add_u64(&temp_file_count, 1);
+    int n = snprintf(temp_path, (size_t)temp_path_len, "%s.tmp.%" PRIu64 ".%" PRIu64, path,
+                     process_id(), count);
+    if (n < 0 || (u64)n >= temp_path_len) {
+        return false;
+    }
+    FILE *file = fopen(temp_path, "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(bytes, 1, (size_t)len, file) == len;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        remove(temp_path);
+    }
+    return ok;
+}
+
+// Write the file to a temporary file and then move it over the old one, so there's always a whole
+// file on disk even if the job is killed while writing.
+bool write_file_replacing(const char *path, const void *bytes, u64 len) {
+    char temp_path[1024];
+    if (!write_temp_file(path, bytes, len, temp_path, sizeof(temp_path))) {
+        return false;
+    }
+#if defined(_WIN32)
+    bool ok = MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool ok = rename(temp_path, path) == 0;
+#endif
+    if (!ok) {
+        remove(temp_path);
+    }
+    return ok;
+}
+
+// The same, but only if there's no file at `path` yet. Returns false if there already was one (or
+// it couldn't be written). Moving the file into place fails if there's one there, so only one
+// writer can ever create it, and no one sees it half written.
+bool write_file_once(const char *path, const void *bytes, u64 len) {
+    char temp_path[1024];
+    if (!write_temp_file(path, bytes, len, temp_path, sizeof(temp_path))) {
+        return false;
+    }
+#if defined(_WIN32)
+    bool ok = MoveFileExA(temp_path, path, 0) != 0;
+    if (!ok) {
+        remove(temp_path);
+    }
+#else
+    bool ok = link(temp_path, path) == 0;
+    remove(temp_path);
+#endif
+    return ok;
+}
+
+bool checkpoint_save(const char *path, const Checkpoint *checkpoint) {
+    u8 bytes[CHECKPOINT_SIZE];
+    checkpoint_encode(checkpoint, bytes);
+    return write_file_replacing(path, bytes, sizeof(bytes));
+}
+
+// Returns false if there's no checkpoint at `path` (`exists` is set to false) or it isn't
+// valid.
+bool checkpoint_load(const char *path, Checkpoint *checkpoint, bool *exists) {
+    FILE *file = fopen(path, "rb");
+    *exists = file != NULL;
+    if (!file) {
+        return false;
+    }
+    u8 bytes[CHECKPOINT_SIZE];
+    bool ok = fread(bytes, 1, sizeof(bytes), file) == sizeof(bytes);
+    fclose(file);
+    return ok && checkpoint_decode(bytes, checkpoint);
+}
+
+typedef struct {
+    const char *checkpoint_dir;
+    bool resume;
+    bool overwrite;
+    u64 checkpoint_ns;
+    // 0 to keep going until every unit is finished.
+    u64 max_puzzles;
+    u64 shard;
+    u64 num_shards;
+    Tile *prefixes;
+    // Updated by the workers.
+    u64 stop;
+    u64 failed;
+    u64 puzzles_this_run;
+    u64 num_puzzles;
+    u64 num_unique;
+    u64 finished_units;
+} Enumerate;
+
+void checkpoint_path(const Enumerate *enumerate, u64 unit, char *path, u64 path_len) {
+    snprintf(path, (size_t)path_len, "%s/unit-%06" PRIu64 ".ckpt", enumerate->checkpoint_dir, unit);
+}
+
+void enumerate_task(void *context, u64 task, i32 worker) {
+    (void)worker;
+    Enumerate *enumerate = context;
+    u64 unit = enumerate->shard + task * enumerate->num_shards;
+    char path[1024];
+    checkpoint_path(enumerate, unit, path, sizeof(path));
+
+    Checkpoint checkpoint = {.unit = unit};
+    const Tile *prefix = &enumerate->prefixes[unit * GENERATE_PREFIX_SLOTS];
+    bool exists = false;
+    bool resumed = enumerate->resume && checkpoint_load(path, &checkpoint, &exists);
+    if (exists) {
+        // Make sure it's the same unit, in case the checkpoints are from a different version.
+        bool same = resumed && checkpoint.unit == unit &&
+                    checkpoint.state.first_slot == GENERATE_PREFIX_SLOTS &&
+                    checkpoint.state.end_slot == 64;
+        for (i32 i = 0; same && i < GENERATE_PREFIX_SLOTS; i++) {
+            same = checkpoint.state.puzzle_tiles[i] == prefix[i];
+        }
+        if (!same) {
+            fprintf(stderr, "checkpoint %s is corrupt or doesn't match unit %" PRIu64 "\n", path,
+                    unit);
+            atomic_store_u64(&enumerate->failed, 1);
+            atomic_store_u64(&enumerate->stop, 1);
+            return;
+        }
+    } else if (atomic_load_u64(&enumerate->stop)) {
+        // Don't start new units after stopping, they'll start fresh next time.
+        return;
+    } else {
+        gen_init(&checkpoint.state, prefix, GENERATE_PREFIX_SLOTS, 64);
+    }
+
+    if (!checkpoint.finished) {
+        u64 last_save = now_ns();
+        while (!atomic_load_u64(&enumerate->stop)) {
+            if (!gen_next(&checkpoint.state)) {
+                checkpoint.finished = true;
+                break;
+            }
+            GeneratedPuzzle puzzle = gen_puzzle(&checkpoint.state);
+            checkpoint.num_puzzles++;
+            checkpoint.num_unique += puzzle.num_solutions == 1;
+            if (enumerate->max_puzzles &&
+                atomic_fetch_add_u64(&enumerate->puzzles_this_run, 1) + 1 >=
+                    enumerate->max_puzzles) {
+                atomic_store_u64(&enumerate->stop, 1);
+            }
+            if (now_ns() - last_save >= enumerate->checkpoint_ns) {
+                if (!checkpoint_save(path, &checkpoint)) {
+                    break;
+                }
+                last_save = now_ns();
+            }
+        }
+        if (!checkpoint_save(path, &checkpoint)) {
+            fprintf(stderr, "could not write checkpoint %s\n", path);
+            atomic_store_u64(&enumerate->failed, 1);
+            atomic_store_u64(&enumerate->stop, 1);
+        }
+    }
+
+    atomic_fetch_add_u64(&enumerate->num_puzzles, checkpoint.num_puzzles);
+    atomic_fetch_add_u64(&enumerate->num_unique, checkpoint.num_unique);
+    if (checkpoint.finished) {
+        atomic_fetch_add_u64(&enumerate->finished_units, 1);
+    }
+}
+
+// dandd enumerate [--checkpoints dir] [--resume | --overwrite] [--every seconds]
+//                 [--shard i --shards n] [--threads n] [--max-puzzles n]
+int enumerate_main(int argc, char **argv) {
+    Enumerate enumerate = {.checkpoint_dir = ".",
+                           .checkpoint_ns = (u64)ENUMERATE_DEFAULT_SECONDS * 1000000000,
+                           .num_shards = 1};
+    i32 num_threads = 1;
+    bool ok = true;
+    for (int i = 0; ok && i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--checkpoints") == 0 && has_value) {
+            enumerate.checkpoint_dir = argv[++i];
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            enumerate.resume = true;
+        } else if (strcmp(argv[i], "--overwrite") == 0) {
+            enumerate.overwrite = true;
+        } else if (strcmp(argv[i], "--every") == 0 && has_value) {
+            ok = parse_seconds(argv[++i], &enumerate.checkpoint_ns);
+        } else if (strcmp(argv[i], "--shard") == 0 && has_value) {
+            ok = parse_count(argv[++i], UINT64_MAX, &enumerate.shard);
+        } else if (strcmp(argv[i], "--shards") == 0 && has_value) {
+            ok = parse_count(argv[++i], UINT64_MAX, &enumerate.num_shards);
+        } else if (strcmp(argv[i], "--threads") == 0 && has_value) {
+            ok = parse_threads(argv[++i], &num_threads);
+        } else if (strcmp(argv[i], "--max-puzzles") == 0 && has_value) {
+            ok = parse_count(argv[++i], UINT64_MAX, &enumerate.max_puzzles);
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || (enumerate.resume && enumerate.overwrite)) {
+        fprintf(stderr, "usage: dandd enumerate [--checkpoints dir] [--resume | --overwrite] "
+                        "[--every seconds] [--shard i --shards n] [--threads n] "
+                        "[--max-puzzles n]\n");
+        return 1;
+    }
+    if (enumerate.num_shards == 0 || enumerate.shard >= enumerate.num_shards) {
+        fprintf(stderr, "--shard must be less than --shards\n");
+        return 1;
+    }
+
+    init_masks();
+    u64 num_units;
+    enumerate.prefixes = generate_prefixes(&num_units);
+    if (!enumerate.prefixes) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    // The units in this shard are shard, shard + num_shards, shard + 2 * num_shards...
+    u64 num_tasks = num_units > enumerate.shard
+                        ? (num_units - enumerate.shard - 1) / enumerate.num_shards + 1
+                        : 0;
+    // Starting over would throw away the checkpoints from an earlier run, so that has to be asked
+    // for.
+    if (!enumerate.resume && !enumerate.overwrite) {
+        for (u64 i = 0; i < num_tasks; i++) {
+            char path[1024];
+            checkpoint_path(&enumerate, enumerate.shard + i * enumerate.num_shards, path,
+                            sizeof(path));
+            if (file_exists(path)) {
+                fprintf(stderr, "checkpoint %s already exists, use --resume to pick it up or "
+                                "--overwrite to start over\n", path);
+                free(enumerate.prefixes);
+                return 1;
+            }
+        }
+    }
+    if (!run_tasks(num_tasks, num_threads, enumerate_task, &enumerate)) {
+        for (u64 i = 0; i < num_tasks; i++) {
+            enumerate_task(&enumerate, i, 0);
+        }
+    }
+    free(enumerate.prefixes);
+
+    printf("units: %" PRIu64 " of %" PRIu64 " finished\n", enumerate.finished_units, num_tasks);
+    printf("puzzles: %" PRIu64 "\n", enumerate.num_puzzles);
+    printf("unique puzzles: %" PRIu64 "\n", enumerate.num_unique);
+    return enumerate.failed ? 1 : 0;
+}
+
+#endif
+
+// Puzzle database.
+// A file of packed puzzle records that can be mapped into memory and used as is, with no parsing.
+// The file is a header, the records, and then an index of record hashes sorted by hash, for
+// looking puzzles up. Everything is little endian u64s so the records can be read straight out of
+// the mapping on little endian machines (all the platforms CI runs on).
+
+#define PUZZLE_DB_MAGIC 0x3142445344444e44 // "DNDDSDB1"
+#define PUZZLE_DB_VERSION 1
+// Written as a u64, reads back differently on a machine with the other byte order.
+#define PUZZLE_DB_BYTE_ORDER 0x0102030405060708
+#define PUZZLE_DB_BUFFER_SIZE (1 << 20)
+
+typedef struct {
+    u64 magic;
+    u64 version;
+    u64 byte_order;
+    u64 record_size;
+    u64 num_records;
+    // Where the index starts in the file, it has num_records entries.
+    u64 index_offset;
+    u64 reserved[2];
+} PuzzleDbHeader;
+
+// A generated puzzle. The row wall counts are the low 8 nibbles of `counts` and the col wall
+// counts are the high 8.
+typedef struct {
+    u64 counts;
+    u64 monsters;
+    u64 treasures;
+    // The board the puzzle was generated from.
+    u64 solution;
+    u64 num_solutions;
+} PuzzleRecord;
+
+typedef struct {
+    u64 hash;
+    u64 record;
+} PuzzleDbIndexEntry;
+
+PuzzleRecord puzzle_record(GeneratedPuzzle puzzle) {
+    return (PuzzleRecord){.counts = pack_counts(puzzle.puzzle),
+                          .monsters = puzzle.puzzle.monsters,
+                          .treasures = puzzle.puzzle.treasures,
+                          .solution = puzzle.solution,
+                          .num_solutions = puzzle.num_solutions};
+}
+
+GeneratedPuzzle puzzle_from_record(const PuzzleRecord *record) {
+    GeneratedPuzzle puzzle = {.puzzle = {.monsters = record->monsters,
+                                         .treasures = record->treasures},
+                              .solution = record->solution,
+                              .num_solutions = record->num_solutions};
+    for (i32 i = 0; i < 8; i++) {
+        puzzle.puzzle.row_wall_counts[i] = (u8)((record->counts >> (4 * i)) & 0xF);
+        puzzle.puzzle.col_wall_counts[i] = (u8)((record->counts >> (32 + 4 * i)) & 0xF);
+    }
+    return puzzle;
+}
+
+typedef struct {
+    FILE *file;
+    char *buffer;
+    PuzzleDbIndexEntry *index;
+    u64 num_records;
+    u64 index_cap;
+    bool failed;
+} PuzzleDbWriter;
+
+bool write_u64s(FILE *file, const u64 *values, u64 count) {
+    u8 bytes[8];
+    for (u64 i = 0; i < count; i++) {
+        put_u64(bytes, values[i]);
+        if (fwrite(bytes, 1, 8, file) != 8) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool puzzle_db_create(PuzzleDbWriter *writer, const char *path) {
+    *writer = (PuzzleDbWriter){0};
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        return false;
+    }
+    writer->buffer = malloc(PUZZLE_DB_BUFFER_SIZE);
+    if (writer->buffer) {
+        setvbuf(writer->file, writer->buffer, _IOFBF, PUZZLE_DB_BUFFER_SIZE);
+    }
+    // The header is filled in once the number of records is known.
+    PuzzleDbHeader header = {0};
+    writer->failed = !write_u64s(writer->file, (const u64 *)&header, sizeof(header) / 8);
+    return true;
+}
+
+void puzzle_db_append(PuzzleDbWriter *writer, GeneratedPuzzle puzzle) {
+    if (writer->failed) {
+        return;
+    }
+    if (writer->num_records == writer->index_cap) {
+        u64 cap = writer->index_cap ? writer->index_cap * 2 : 1024;
+        if (cap > SIZE_MAX / sizeof(PuzzleDbIndexEntry)) {
+            writer->failed = true;
+            return;
+        }
+        PuzzleDbIndexEntry *index =
+            realloc(writer->index, (size_t)cap * sizeof(PuzzleDbIndexEntry));
+        if (!index) {
+            writer->failed = true;
+            return;
+        }
+        writer->index = index;
+        writer->index_cap = cap;
+    }
+    PuzzleRecord record = puzzle_record(puzzle);
+    writer->index[writer->num_records] =
+        (PuzzleDbIndexEntry){.hash = puzzle_hash(puzzle.puzzle), .record = writer->num_records};
+    writer->num_records++;
+    writer->failed = !write_u64s(writer->file, (const u64 *)&record, sizeof(record) / 8);
+}
+
+int compare_index_entries(const void *a, const void *b) {
+    const PuzzleDbIndexEntry *x = a;
+    const PuzzleDbIndexEntry *y = b;
+    if (x->hash != y->hash) {
+        return x->hash < y->hash ? -1 : 1;
+    }
+    return (x->record > y->record) - (x->record < y->record);
+}
+
+// Write the index and the header and close the file. Returns false if anything failed to write.
+bool puzzle_db_finish(PuzzleDbWriter *writer) {
+    bool ok = !writer->failed;
+    if (ok) {
+        qsort(writer->index, (size_t)writer->num_records, sizeof(PuzzleDbIndexEntry),
+              compare_index_entries);
+        ok = write_u64s(writer->file, (const u64 *)writer->index, writer->num_records * 2);
+    }
+    if (ok) {
+        PuzzleDbHeader header = {
+            .magic = PUZZLE_DB_MAGIC,
+            .version = PUZZLE_DB_VERSION,
+            .byte_order = PUZZLE_DB_BYTE_ORDER,
+            .record_size = sizeof(PuzzleRecord),
+            .num_records = writer->num_records,
+            .index_offset = sizeof(PuzzleDbHeader) + writer->num_records * sizeof(PuzzleRecord)};
+        ok = fseek(writer->file, 0, SEEK_SET) == 0 &&
+             write_u64s(writer->file, (const u64 *)&header, sizeof(header) / 8);
+    }
+    ok = fclose(writer->file) == 0 && ok;
+    free(writer->buffer);
+    free(writer->index);
+    *writer = (PuzzleDbWriter){0};
+    return ok;
+}
+
+typedef struct {
+    const u8 *data;
+    u64 size;
+    const PuzzleDbHeader *header;
+    const PuzzleRecord *records;
+    const PuzzleDbIndexEntry *index;
+    u64 num_records;
+#if defined(_WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} PuzzleDb;
+
+void puzzle_db_close(PuzzleDb *db) {
+#if defined(_WIN32)
+    if (db->data) {
+        UnmapViewOfFile(db->data);
+    }
+    if (db->mapping) {
+        CloseHandle(db->mapping);
+    }
+    if (db->file && db->file != INVALID_HANDLE_VALUE) {
+        CloseHandle(db->file);
+    }
+#else
+    if (db->data) {
+        munmap((void *)db->data, (size_t)db->size);
+    }
+    if (db->fd >= 0) {
+        close(db->fd);
+    }
+#endif
+    *db = (PuzzleDb){0};
+#if !defined(_WIN32)
+    db->fd = -1;
+#endif
+}
+
+// Map a puzzle database into memory. Returns false if it can't be opened or isn't a valid
+// database for this machine.
+bool puzzle_db_open(PuzzleDb *db, const char *path) {
+    *db = (PuzzleDb){0};
+#if defined(_WIN32)
+    db->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+    if (db->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(db->file, &size)) {
+        puzzle_db_close(db);
+        return false;
+    }
+    db->size = (u64)size.QuadPart;
+    if (db->size >= sizeof(PuzzleDbHeader)) {
+        db->mapping = CreateFileMappingA(db->file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (db->mapping) {
+            db->data = MapViewOfFile(db->mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+    }
+#else
+    db->fd = open(path, O_RDONLY);
+    struct stat st;
+    if (db->fd < 0 || fstat(db->fd, &st) != 0) {
+        puzzle_db_close(db);
+        return false;
+    }
+    db->size = (u64)st.st_size;
+    if (db->size >= sizeof(PuzzleDbHeader)) {
+        void *data = mmap(NULL, (size_t)db->size, PROT_READ, MAP_PRIVATE, db->fd, 0);
+        db->data = data == MAP_FAILED ? NULL : data;
+    }
+#endif
+    if (!db->data) {
+        puzzle_db_close(db);
+        return false;
+    }
+
+    const PuzzleDbHeader *header = (const PuzzleDbHeader *)db->data;
+    u64 records_size = header->num_records * sizeof(PuzzleRecord);
+    if (header->magic != PUZZLE_DB_MAGIC || header->version != PUZZLE_DB_VERSION ||
+        header->byte_order != PUZZLE_DB_BYTE_ORDER ||
+        header->record_size != sizeof(PuzzleRecord) ||
+        header->num_records > db->size / sizeof(PuzzleRecord) ||
+        header->index_offset != sizeof(PuzzleDbHeader) + records_size ||
+        db->size !=
+            header->index_offset + header->num_records * sizeof(PuzzleDbIndexEntry)) {
+        puzzle_db_close(db);
+        return false;
+    }
+    db->header = header;
+    db->num_records = header->num_records;
+    db->records = (const PuzzleRecord *)(db->data + sizeof(PuzzleDbHeader));
+    db->index = (const PuzzleDbIndexEntry *)(db->data + header->index_offset);
+    // puzzle_db_find trusts the index, so a bad record number or an unsorted index fails here.
+    for (u64 i = 0; i < db->num_records; i++) {
+        if (db->index[i].record >= db->num_records ||
+            (i > 0 && db->index[i - 1].hash > db->index[i].hash)) {
+            puzzle_db_close(db);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Find a puzzle in the database. Returns its record's index, or num_records if it isn't there.
+u64 puzzle_db_find(const PuzzleDb *db, Puzzle puzzle) {
+    if (!counts_are_valid(puzzle)) {
+        return db->num_records;
+    }
+    u64 hash = puzzle_hash(puzzle);
+    u64 counts = pack_counts(puzzle);
+    // The first index entry with this hash.
+    u64 low = 0;
+    u64 high = db->num_records;
+    while (low < high) {
+        u64 mid = low + (high - low) / 2;
+        if (db->index[mid].hash < hash) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    for (u64 i = low; i < db->num_records && db->index[i].hash == hash; i++) {
+        const PuzzleRecord *record = &db->records[db->index[i].record];
+        if (record->counts == counts && record->monsters == puzzle.monsters &&
+            record->treasures == puzzle.treasures) {
+            return db->index[i].record;
+        }
+    }
+    return db->num_records;
+}
+
+#if !defined(DANDD_LIBRARY)
+#define DB_WRITE_BATCH_SIZE 4096
+
+// `db write` streams the generator's puzzles into the database a batch at a time, so it only ever
+// holds a batch of them (and the index) in memory.
+typedef struct {
+    PuzzleDbWriter writer;
+    GeneratedPuzzle *batch;
+    u64 batch_len;
+    u64 max_puzzles;
+    u64 num_puzzles;
+    i32 num_threads;
+} DbWrite;
+
+void db_write_count_task(void *context, u64 task, i32 worker) {
+    (void)worker;
+    DbWrite *db_write = context;
+    // The generator stops counting at 2 solutions, the database gets the real count.
+    if (db_write->batch[task].num_solutions > 1) {
+        db_write->batch[task].num_solutions = count_solutions(db_write->batch[task].puzzle);
+    }
+}
+
+void db_write_flush(DbWrite *db_write) {
+    if (db_write->num_threads <= 1 || db_write->batch_len <= 1 ||
+        !run_tasks(db_write->batch_len, db_write->num_threads, db_write_count_task, db_write)) {
+        for (u64 i = 0; i < db_write->batch_len; i++) {
+            db_write_count_task(db_write, i, 0);
+        }
+    }
+    for (u64 i = 0; i < db_write->batch_len; i++) {
+        puzzle_db_append(&db_write->writer, db_write->batch[i]);
+    }
+    db_write->batch_len = 0;
+}
+
+bool db_write_puzzle(void *userdata, GeneratedPuzzle puzzle) {
+    DbWrite *db_write = userdata;
+    db_write->batch[db_write->batch_len++] = puzzle;
+    db_write->num_puzzles++;
+    if (db_write->batch_len == DB_WRITE_BATCH_SIZE) {
+        db_write_flush(db_write);
+    }
+    return db_write->num_puzzles < db_write->max_puzzles && !db_write->writer.failed;
+}
+
+// dandd db write <path> <num_puzzles> [--threads n]
+// dandd db info <path>
+int db_main(int argc, char **argv) {
+    DbWrite db_write = {.num_threads = 1};
+    if ((argc == 3 || (argc == 5 && strcmp(argv[3], "--threads") == 0 &&
+                       parse_threads(argv[4], &db_write.num_threads))) &&
+        strcmp(argv[0], "write") == 0 && parse_count(argv[2], UINT64_MAX, &db_write.max_puzzles)) {
+        db_write.batch = malloc(DB_WRITE_BATCH_SIZE * sizeof(GeneratedPuzzle));
+        if (!db_write.batch || !puzzle_db_create(&db_write.writer, argv[1])) {
+            fprintf(stderr, "could not create %s\n", argv[1]);
+            free(db_write.batch);
+            return 1;
+        }
+        if (db_write.max_puzzles > 0) {
+            generate_each(db_write_puzzle, &db_write);
+        }
+        db_write_flush(&db_write);
+        free(db_write.batch);
+        if (!puzzle_db_finish(&db_write.writer)) {
+            fprintf(stderr, "could not write %s\n", argv[1]);
+            return 1;
+        }
+        printf("wrote %" PRIu64 " puzzles to %s\n", db_write.num_puzzles, argv[1]);
+        return 0;
+    }
+    if (argc >= 2 && strcmp(argv[0], "info") == 0) {
+        PuzzleDb db;
+        if (!puzzle_db_open(&db, argv[1])) {
+            fprintf(stderr, "could not open %s, or it isn't a puzzle database\n", argv[1]);
+            return 1;
+        }
+        u64 num_unique = 0;
+        u64 num_missing = 0;
+        for (u64 i = 0; i < db.num_records; i++) {
+            GeneratedPuzzle puzzle = puzzle_from_record(&db.records[i]);
+            num_unique += puzzle.num_solutions == 1;
+            // Every puzzle should be found by the index, as this record or an earlier duplicate.
+            num_missing += puzzle_db_find(&db, puzzle.puzzle) > i;
+        }
+        printf("puzzles: %" PRIu64 "\n", db.num_records);
+        printf("unique puzzles: %" PRIu64 "\n", num_unique);
+        if (num_missing) {
+            printf("puzzles missing from the index: %" PRIu64 "\n", num_missing);
+        }
+        puzzle_db_close(&db);
+        return num_missing ? 1 : 0;
+    }
+    fprintf(stderr, "usage: dandd db write <path> <num_puzzles> [--threads n]\n"
+                    "       dandd db info <path>\n");
+    return 1;
+}
+#endif
+
+// Everything from here on is the command line program, it isn't in the library.
+#if !defined(DANDD_LIBRARY)
+
+// Benchmarks.
+// `dandd bench` times the solvers on a corpus of puzzles (one at a time and as a batch, with and
+// without the lane solver) and the generator, so changes can be measured. The corpus is a text
+// file with a puzzle per line, the 8 row wall counts, the 8 column wall counts and then the 64
+// tiles in row-major order, `.` for empty, `M` for a monster and `T` for a treasure. Lines
+// starting with `#` are comments.
+
+#define BENCH_DEFAULT_TRIALS 5
+#define BENCH_GENERATE_PUZZLES 2000
+// Throughput can drop this much compared to the baseline before `--check` fails. It's generous
+// because CI machines are noisy and aren't the machine the baseline was recorded on.
+#define BENCH_TOLERANCE 3.0
+
+// Parse a corpus line into a puzzle. Returns false if the line isn't a puzzle.
+bool parse_puzzle(const char *line, Puzzle *out) {
+    char rows[9];
+    char cols[9];
+    char tiles[65];
+    if (sscanf(line, "%8s %8s %64s", rows, cols, tiles) != 3 || strlen(rows) != 8 ||
+        strlen(cols) != 8 || strlen(tiles) != 64) {
+        return false;
+    }
+    Puzzle p = (Puzzle){};
+    for (i32 i = 0; i < 8; i++) {
+        if (rows[i] < '0' || rows[i] > '8' || cols[i] < '0' || cols[i] > '8') {
+            return false;
+        }
+        p.row_wall_counts[i] = (u8)(rows[i] - '0');
+        p.col_wall_counts[i] = (u8)(cols[i] - '0');
+    }
+    for (i32 slot = 0; slot < 64; slot++) {
+        switch (tiles[slot]) {
+        case '.':
+            break;
+        case 'M':
+            p.monsters = slot_set(p.monsters, slot);
+            break;
+        case 'T':
+            p.treasures = slot_set(p.treasures, slot);
+            break;
+        default:
+            return false;
+        }
+    }
+    *out = p;
+    return true;
+}
+
+typedef struct {
+    Puzzle *puzzles;
+    u64 len;
+    u64 cap;
+} Corpus;
+
+void corpus_free(Corpus *corpus) {
+    free(corpus->puzzles);
+    *corpus = (Corpus){0};
+}
+
+// Load a corpus file. Prints an error and returns false if it can't be read.
+bool corpus_load(const char *path, Corpus *corpus) {
+    *corpus = (Corpus){0};
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "could not open corpus %s\n", path);
+        return false;
+    }
+    char line[256];
+    u64 line_number = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+            continue;
+        }
+        Puzzle p;
+        if (!parse_puzzle(line, &p)) {
+            fprintf(stderr, "%s:%" PRIu64 ": not a puzzle\n", path, line_number);
+            ok = false;
+            break;
+        }
+        if (corpus->len == corpus->cap) {
+            u64 cap = corpus->cap ? corpus->cap * 2 : 64;
+            Puzzle *puzzles = realloc(corpus->puzzles, cap * sizeof(Puzzle));
+            if (!puzzles) {
+                fprintf(stderr, "out of memory loading corpus\n");
+                ok = false;
+                break;
+            }
+            corpus->puzzles = puzzles;
+            corpus->cap = cap;
+        }
+        corpus->puzzles[corpus->len++] = p;
+    }
+    fclose(file);
+    if (ok && corpus->len == 0) {
+        fprintf(stderr, "corpus %s is empty\n", path);
+        ok = false;
+    }
+    if (!ok) {
+        corpus_free(corpus);
+    }
+    return ok;
+}
+
+typedef SolveResult (*SolveEngine)(Puzzle, u64 *, u64, SolveMode);
+typedef u64 (*GenerateEngine)(GeneratedPuzzle *, u64);
+typedef void (*BatchEngine)(const SolveBatch *, u64, u64);
+
+typedef struct {
+    const char *name;
+    // Time for each item (a puzzle solved or a puzzle generated) over all the trials, sorted.
+    u64 *samples;
+    u64 num_samples;
+    u64 total_ns;
+    // Solutions found or puzzles generated in one trial, so runs can be sanity checked.
+    u64 checksum;
+} BenchResult;
+
+int compare_u64(const void *a, const void *b) {
+    u64 x = *(const u64 *)a;
+    u64 y = *(const u64 *)b;
+    return (x > y) - (x < y);
+}
+
+u64 bench_percentile(const BenchResult *result, u64 percent) {
+    u64 i = (result->num_samples - 1) * percent / 100;
+    return result->samples[i];
+}
+
+double bench_ns_per_item(const BenchResult *result) {
+    return (double)result->total_ns / (double)result->num_samples;
+}
+
+// Solve every puzzle in the corpus once to warm up, then `trials` more times, timing each solve.
+// If `checks` is set, `solve` runs with them instead of `engine` being called. Returns false if out
+// of memory.
+bool bench_solve(const char *name, SolveEngine engine, const CheckPipeline *checks,
+                 const Corpus *corpus, u64 trials, BenchResult *result) {
+    *result = (BenchResult){.name = name, .num_samples = corpus->len * trials};
+    result->samples = malloc(result->num_samples * sizeof(u64));
+    if (!result->samples) {
+        return false;
+    }
+    u64 solutions[64];
+    for (u64 trial = 0; trial <= trials; trial++) {
+        u64 checksum = 0;
+        for (u64 i = 0; i < corpus->len; i++) {
+            u64 start = now_ns();
+            Puzzle puzzle = corpus->puzzles[i];
+            SolveResult solved =
+                checks ? solve_with_stats(puzzle, solutions, 64, SOLVE_ALL, checks, NULL)
+                       : engine(puzzle, solutions, 64, SOLVE_ALL);
+            checksum += solved.num_solutions;
+            u64 elapsed = now_ns() - start;
+            if (trial > 0) {
+                result->samples[(trial - 1) * corpus->len + i] = elapsed;
+                result->total_ns += elapsed;
+            }
+        }
+        result->checksum = checksum;
+    }
+    qsort(result->samples, result->num_samples, sizeof(u64), compare_u64);
+    return true;
+}
+
+// Solve the whole corpus as a batch on this thread once to warm up, then `trials` more times.
+// There's one sample per trial, the average time per puzzle. Returns false if out of memory.
+bool bench_solve_batch(const char *name, BatchEngine engine, const Corpus *corpus, u64 trials,
+                       BenchResult *result) {
+    *result = (BenchResult){.name = name, .num_samples = trials};
+    result->samples = malloc(trials * sizeof(u64));
+    u64 *solutions = malloc(corpus->len * 64 * sizeof(u64));
+    SolveResult *results = malloc(corpus->len * sizeof(SolveResult));
+    if (!result->samples || !solutions || !results) {
+        free(result->samples);
+        free(solutions);
+        free(results);
+        return false;
+    }
+    SolveBatch batch = {.puzzles = corpus->puzzles,
+                        .num_puzzles = corpus->len,
+                        .solutions = solutions,
+                        .max_solutions = 64,
+                        .mode = SOLVE_ALL,
+                        .results = results};
+    for (u64 trial = 0; trial <= trials; trial++) {
+        u64 start = now_ns();
+        engine(&batch, 0, corpus->len);
+        u64 elapsed = now_ns() - start;
+        result->checksum = 0;
+        for (u64 i = 0; i < corpus->len; i++) {
+            result->checksum += results[i].num_solutions;
+        }
+        if (trial > 0) {
+            result->samples[trial - 1] = elapsed / corpus->len;
+            result->total_ns += elapsed / corpus->len;
+        }
+    }
+    free(solutions);
+    free(results);
+    qsort(result->samples, result->num_samples, sizeof(u64), compare_u64);
+    return true;
+}
+
+// Generate the first `num_puzzles` puzzles once to warm up, then `trials` more times. There's one
+// sample per trial, the average time per generated puzzle. If `checks` is set, `generate` runs with
+// them instead of `engine` being called. Returns false if out of memory or nothing was generated.
+bool bench_generate(const char *name, GenerateEngine engine, const CheckPipeline *checks,
+                    u64 num_puzzles, u64 trials, BenchResult *result) {
+    *result = (BenchResult){.name = name, .num_samples = trials};
+    result->samples = calloc(trials, sizeof(u64));
+    GeneratedPuzzle *puzzles = malloc(num_puzzles * sizeof(GeneratedPuzzle));
+    if (!result->samples || !puzzles) {
+        free(result->samples);
+        free(puzzles);
+        return false;
+    }
+    for (u64 trial = 0; trial <= trials; trial++) {
+        u64 start = now_ns();
+        u64 generated = checks ? generate_with_stats(puzzles, num_puzzles, checks, NULL)
+                               : engine(puzzles, num_puzzles);
+        u64 elapsed = now_ns() - start;
+        result->checksum = generated;
+        // There's no time per puzzle without any puzzles, and a generator that finds none is
+        // broken anyway.
+        if (generated == 0) {
+            fprintf(stderr, "%s generated no puzzles\n", name);
+            free(result->samples);
+            free(puzzles);
+            return false;
+        }
+        if (trial > 0) {
+            result->samples[trial - 1] = elapsed / generated;
+            result->total_ns += elapsed / generated;
+        }
+    }
+    free(puzzles);
+    qsort(result->samples, result->num_samples, sizeof(u64), compare_u64);
+    return true;
+}
+
+void print_bench_result(const BenchResult *result) {
+    double ns = bench_ns_per_item(result);
+    printf("%-16s %12.0f %12.0f %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64
+           " %10" PRIu64 "\n",
+           result->name, ns, 1e9 / ns, bench_percentile(result, 50), bench_percentile(result, 90),
+           bench_percentile(result, 99), result->samples[result->num_samples - 1],
+           result->checksum);
+}
+
+#if defined(DANDD_STATS)
+// Solve the corpus and generate puzzles once counting rejections, and tune copies of the default
+// check pipelines from the counts.
+void bench_tune(const Corpus *corpus, CheckPipeline *solve_tuned,
+                CheckPipeline *generate_tuned) {
+    *solve_tuned = solve_checks;
+    *generate_tuned = generate_checks;
+    SolveStats solve_stats = {0};
+    u64 solutions[64];
+    for (u64 i = 0; i < corpus->len; i++) {
+        solve_with_stats(corpus->puzzles[i], solutions, 64, SOLVE_ALL, NULL, &solve_stats);
+    }
+    tune_checks(solve_tuned, &solve_stats);
+
+    GenerateStats generate_stats = {0};
+    GeneratedPuzzle *puzzles = malloc(BENCH_GENERATE_PUZZLES * sizeof(GeneratedPuzzle));
+    if (puzzles) {
+        generate_with_stats(puzzles, BENCH_GENERATE_PUZZLES, NULL, &generate_stats);
+        tune_checks(generate_tuned, &generate_stats.search);
+        free(puzzles);
+    }
+}
+
+// Run the corpus (or the generator) once more counting nodes, and combine it with the times from
+// the benchmark to get nodes per second.
+void print_bench_nodes(const char *name, u64 nodes, u64 items, const BenchResult *result) {
+    double nodes_per_item = (double)nodes / (double)items;
+    printf("%-16s %12.0f nodes/item %14.0f nodes/s\n", name, nodes_per_item,
+           nodes_per_item / bench_ns_per_item(result) * 1e9);
+}
+
+void bench_nodes(const Corpus *corpus, const BenchResult *solve_result,
+                 const BenchResult *generate_result) {
+    SolveStats solve_stats = {0};
+    u64 solutions[64];
+    for (u64 i = 0; i < corpus->len; i++) {
+        solve_with_stats(corpus->puzzles[i], solutions, 64, SOLVE_ALL, NULL, &solve_stats);
+    }
+    print_bench_nodes("solve", solve_stats.nodes, corpus->len, solve_result);
+
+    GenerateStats generate_stats = {0};
+    GeneratedPuzzle *puzzles = malloc(BENCH_GENERATE_PUZZLES * sizeof(GeneratedPuzzle));
+    if (puzzles) {
+        u64 generated =
+            generate_with_stats(puzzles, BENCH_GENERATE_PUZZLES, NULL, &generate_stats);
+        print_bench_nodes("generate", generate_stats.search.nodes + generate_stats.solve.nodes,
+                          generated, generate_result);
+        free(puzzles);
+    }
+}
+#endif
+
+// Baseline files have a benchmark per line, its name and its ns per item.
+bool save_baseline(const char *path, const BenchResult *results, u64 num_results) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "could not write baseline %s\n", path);
+        return false;
+    }
+    fprintf(file, "# name ns_per_item\n");
+    for (u64 i = 0; i < num_results; i++) {
+        fprintf(file, "%s %.0f\n", results[i].name, bench_ns_per_item(&results[i]));
+    }
+    fclose(file);
+    return true;
+}
+
+// Compare against a baseline file. Returns false if anything got more than BENCH_TOLERANCE times
+// slower. Benchmarks that aren't in the baseline are skipped.
+bool check_baseline(const char *path, const BenchResult *results, u64 num_results) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "could not open baseline %s\n", path);
+        return false;
+    }
+    bool ok = true;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        char name[64];
+        double baseline_ns;
+        if (line[0] == '#' || sscanf(line, "%63s %lf", name, &baseline_ns) != 2) {
+            continue;
+        }
+        for (u64 i = 0; i < num_results; i++) {
+            if (strcmp(results[i].name, name) != 0) {
+                continue;
+            }
+            double ns = bench_ns_per_item(&results[i]);
+            bool regressed = ns > baseline_ns * BENCH_TOLERANCE;
+            printf("%-16s %12.0f vs baseline %12.0f (%.2fx)%s\n", name, ns, baseline_ns,
+                   ns / baseline_ns, regressed ? " REGRESSION" : "");
+            if (regressed) {
+                ok = false;
+            }
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+// dandd bench [corpus] [--trials n] [--tune] [--save baseline] [--check baseline]
+int bench(int argc, char **argv) {
+    const char *corpus_path = "bench/corpus.txt";
+    const char *save_path = NULL;
+    const char *check_path = NULL;
+    u64 trials = BENCH_DEFAULT_TRIALS;
+    bool tune = false;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--trials") == 0 && i + 1 < argc) {
+            trials = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--tune") == 0) {
+            tune = true;
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc) {
+            check_path = argv[++i];
+        } else if (argv[i][0] != '-') {
+            corpus_path = argv[i];
+        } else {
+            fprintf(stderr, "usage: dandd bench [corpus] [--trials n] [--tune] [--save baseline] "
+                            "[--check baseline]\n");
+            return 1;
+        }
+    }
+    if (trials == 0) {
+        trials = 1;
+    }
+#if !defined(DANDD_STATS)
+    if (tune) {
+        fprintf(stderr, "--tune needs the rejection counts from a DANDD_STATS build\n");
+        return 1;
+    }
+#endif
+
+    Corpus corpus;
+    if (!corpus_load(corpus_path, &corpus)) {
+        return 1;
+    }
+    init_masks();
+    printf("%" PRIu64 " puzzles from %s, %" PRIu64 " trials\n", corpus.len, corpus_path, trials);
+    print_checks("solve", &solve_checks);
+    print_checks("generate", &generate_checks);
+    // With --tune, `solve` and `generate` are timed again with the tuned checks.
+    CheckPipeline solve_tuned;
+    CheckPipeline generate_tuned;
+#if defined(DANDD_STATS)
+    if (tune) {
+        bench_tune(&corpus, &solve_tuned, &generate_tuned);
+        print_checks("solve (tuned)", &solve_tuned);
+        print_checks("generate (tuned)", &generate_tuned);
+    }
+#endif
+
+    BenchResult results[9];
+    u64 num_results = 0;
+    bool ok = bench_solve("solve", solve, NULL, &corpus, trials, &results[num_results++]) &&
+              bench_solve("solve_rows", solve_rows, NULL, &corpus, trials,
+                          &results[num_results++]) &&
+              bench_solve("solve_propagate", solve_propagate, NULL, &corpus, trials,
+                          &results[num_results++]) &&
+              bench_generate("generate", generate, NULL, BENCH_GENERATE_PUZZLES, trials,
+                             &results[num_results++]) &&
+              bench_generate("generate_walls", generate_walls, NULL, BENCH_GENERATE_PUZZLES, trials,
+                             &results[num_results++]) &&
+              bench_solve_batch("batch_scalar", solve_batch_scalar, &corpus, trials,
+                                &results[num_results++]) &&
+              bench_solve_batch("batch_lanes", solve_lanes, &corpus, trials,
+                                &results[num_results++]);
+    if (ok && tune) {
+        ok = bench_solve("solve_tuned", NULL, &solve_tuned, &corpus, trials,
+                         &results[num_results++]) &&
+             bench_generate("generate_tuned", NULL, &generate_tuned, BENCH_GENERATE_PUZZLES,
+                            trials, &results[num_results++]);
+    }
+    if (!ok) {
+        fprintf(stderr, "could not run the benchmarks\n");
+        num_results--;
+    } else {
+        printf("%-16s %12s %12s %10s %10s %10s %10s %10s\n", "name", "ns/item", "items/s", "p50",
+               "p90", "p99", "max", "checksum");
+        for (u64 i = 0; i < num_results; i++) {
+            print_bench_result(&results[i]);
+        }
+#if defined(DANDD_STATS)
+        bench_nodes(&corpus, &results[0], &results[3]);
+#endif
+        if (save_path) {
+            ok = save_baseline(save_path, results, num_results);
+        }
+        if (ok && check_path) {
+            ok = check_baseline(check_path, results, num_results);
+        }
+    }
+    for (u64 i = 0; i < num_results; i++) {
+        free(results[i].samples);
+    }
+    corpus_free(&corpus);
+    return ok ? 0 : 1;
+}
+
+// Command line driver.
+// `dandd solve`, `dandd generate` and `dandd validate` work on records: a puzzle, a solution and
+// a number of solutions. They're read CLI_BATCH_SIZE at a time from a file or stdin, each batch is
+// worked on by the thread pool, and its output is formatted into one buffer and written with a
+// single fwrite, so small puzzles aren't slowed down by the I/O.
+// * `text` records are a corpus line (see `parse_puzzle`) optionally followed by the solution in
+//   hex and the number of solutions.
+// * `binary` records are a PuzzleRecord, 5 little endian u64s, the same as in a puzzle database.
+// * `grid` output (it can't be read back in) draws each board like `print_puzzle`.
+// The output of `solve` and `generate` can be piped straight into `validate`.
+
+#define CLI_BATCH_SIZE 4096
+#define CLI_DEFAULT_MAX_SOLUTIONS 64
+
+typedef enum { FORMAT_TEXT, FORMAT_BINARY, FORMAT_GRID } Format;
+
+typedef struct {
+    const char *input_path;
+    const char *output_path;
+    Format input_format;
+    Format format;
+    i32 num_threads;
+    SolveMode mode;
+    u64 max_solutions;
+    u64 num_puzzles;
+    bool walls;
+} CliOptions;
+
+// A growing buffer for a batch of output.
+typedef struct {
+    char *data;
+    u64 len;
+    u64 cap;
+    bool failed;
+} OutputBuffer;
+
+// Make room for `len` more bytes. Returns NULL (and marks the buffer failed) if out of memory.
+char *output_reserve(OutputBuffer *out, u64 len) {
+    if (out->failed) {
+        return NULL;
+    }
+    if (out->len + len > out->cap) {
+        u64 cap = out->cap ? out->cap : 1 << 16;
+        while (cap < out->len + len) {
+            cap *= 2;
+        }
+        char *data = realloc(out->data, (size_t)cap);
+        if (!data) {
+            out->failed = true;
+            return NULL;
+        }
+        out->data = data;
+        out->cap = cap;
+    }
+    char *start = out->data + out->len;
+    out->len += len;
+    return start;
+}
+
+void output_string(OutputBuffer *out, const char *string) {
+    u64 len = strlen(string);
+    char *dest = output_reserve(out, len);
+    if (dest) {
+        memcpy(dest, string, (size_t)len);
+    }
+}
+
+// A puzzle as a corpus line, without a newline.
+void output_puzzle_line(OutputBuffer *out, Puzzle puzzle) {
+    char *dest = output_reserve(out, 82);
+    if (!dest) {
+        return;
+    }
+    for (i32 i = 0; i < 8; i++) {
+        dest[i] = (char)('0' + puzzle.row_wall_counts[i]);
+        dest[9 + i] = (char)('0' + puzzle.col_wall_counts[i]);
+    }
+    dest[8] = ' ';
+    dest[17] = ' ';
+    for (i32 slot = 0; slot < 64; slot++) {
+        dest[18 + slot] = slot_is_set(puzzle.monsters, slot)    ? 'M'
+                          : slot_is_set(puzzle.treasures, slot) ? 'T'
+                                                                : '.';
+    }
+}
+
+// A binary record, sizeof(PuzzleRecord) bytes.
+void record_to_bytes(GeneratedPuzzle record, u8 *bytes) {
+    PuzzleRecord packed = puzzle_record(record);
+    for (u64 i = 0; i < sizeof(PuzzleRecord) / 8; i++) {
+        put_u64(&bytes[8 * i], ((const u64 *)&packed)[i]);
+    }
+}
+
+GeneratedPuzzle record_from_bytes(const u8 *bytes) {
+    PuzzleRecord packed;
+    for (u64 i = 0; i < sizeof(PuzzleRecord) / 8; i++) {
+        ((u64 *)&packed)[i] = get_u64(&bytes[8 * i]);
+    }
+    return puzzle_from_record(&packed);
+}
+
+void output_record(OutputBuffer *out, Format format, GeneratedPuzzle record) {
+    if (format == FORMAT_BINARY) {
+        u8 *dest = (u8 *)output_reserve(out, sizeof(PuzzleRecord));
+        if (dest) {
+            record_to_bytes(record, dest);
+        }
+    } else if (format == FORMAT_GRID) {
+        char line[64];
+        snprintf(line, sizeof(line), "solutions: %" PRIu64 "\n", record.num_solutions);
+        output_string(out, line);
+        char *dest = output_reserve(out, PUZZLE_GRID_LEN);
+        if (dest) {
+            format_puzzle_grid(dest, record.puzzle, record.solution);
+        }
+        output_string(out, "\n");
+    } else {
+        output_puzzle_line(out, record.puzzle);
+        char line[64];
+        snprintf(line, sizeof(line), " %016" PRIx64 " %" PRIu64 "\n", record.solution,
+                 record.num_solutions);
+        output_string(out, line);
+    }
+}
+
+// Write out the batch and empty the buffer. Returns false if it couldn't be written.
+bool output_flush(OutputBuffer *out, FILE *file) {
+    bool ok = !out->failed && fwrite(out->data, 1, (size_t)out->len, file) == out->len &&
+              fflush(file) == 0;
+    out->len = 0;
+    return ok;
+}
+
+typedef struct {
+    FILE *file;
+    const char *path;
+    Format format;
+    u64 line_number;
+} RecordReader;
+
+// Read the next record. Returns 1 if there was one, 0 at the end of the input and -1 (after
+// printing an error) if the input isn't valid.
+i32 read_record(RecordReader *reader, GeneratedPuzzle *record) {
+    if (reader->format == FORMAT_BINARY) {
+        u8 bytes[sizeof(PuzzleRecord)];
+        size_t read = fread(bytes, 1, sizeof(bytes), reader->file);
+        if (read == 0) {
+            return 0;
+        }
+        if (read != sizeof(bytes)) {
+            fprintf(stderr, "%s: ends in the middle of a record\n", reader->path);
+            return -1;
+        }
+        *record = record_from_bytes(bytes);
+        return 1;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), reader->file)) {
+        reader->line_number++;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+            continue;
+        }
+        *record = (GeneratedPuzzle){0};
+        if (!parse_puzzle(line, &record->puzzle)) {
+            fprintf(stderr, "%s:%" PRIu64 ": not a puzzle\n", reader->path, reader->line_number);
+            return -1;
+        }
+        // The solution and the number of solutions are optional.
+        sscanf(line, "%*s %*s %*s %" SCNx64 " %" SCNu64, &record->solution,
+               &record->num_solutions);
+        return 1;
+    }
+    return 0;
+}
+
+// Fill `records` with up to CLI_BATCH_SIZE records. Returns the number read, or -1 on an error.
+i64 read_batch(RecordReader *reader, GeneratedPuzzle *records) {
+    i64 len = 0;
+    while (len < CLI_BATCH_SIZE) {
+        i32 read = read_record(reader, &records[len]);
+        if (read < 0) {
+            return -1;
+        }
+        if (read == 0) {
+            break;
+        }
+        len++;
+    }
+    return len;
+}
+
+bool parse_format(const char *name, Format *format) {
+    if (strcmp(name, "text") == 0) {
+        *format = FORMAT_TEXT;
+    } else if (strcmp(name, "binary") == 0) {
+        *format = FORMAT_BINARY;
+    } else if (strcmp(name, "grid") == 0) {
+        *format = FORMAT_GRID;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_mode(const char *name, SolveMode *mode) {
+    if (strcmp(name, "all") == 0) {
+        *mode = SOLVE_ALL;
+    } else if (strcmp(name, "first") == 0) {
+        *mode = SOLVE_FIRST;
+    } else if (strcmp(name, "unique") == 0) {
+        *mode = SOLVE_UNIQUE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Parse the options every command shares. A bare argument is the input file for `solve` and
+// `validate` and the number of puzzles for `generate`. Returns false if they aren't valid.
+bool parse_cli_options(int argc, char **argv, bool generating, CliOptions *options) {
+    *options = (CliOptions){.num_threads = 1, .mode = SOLVE_UNIQUE};
+    for (int i = 0; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--threads") == 0 && has_value) {
+            if (!parse_threads(argv[++i], &options->num_threads)) {
+                return false;
+            }
+        } else if (strcmp(argv[i], "--mode") == 0 && has_value) {
+            if (!parse_mode(argv[++i], &options->mode)) {
+                return false;
+            }
+        } else if (strcmp(argv[i], "--max-solutions") == 0 && has_value) {
+            // Every record in a batch gets room for max_solutions solutions.
+            if (!parse_count(argv[++i], SIZE_MAX / (CLI_BATCH_SIZE * sizeof(u64)),
+                             &options->max_solutions)) {
+                return false;
+            }
+        } else if (strcmp(argv[i], "--format") == 0 && has_value) {
+            if (!parse_format(argv[++i], &options->format)) {
+                return false;
+            }
+        } else if (strcmp(argv[i], "--input-format") == 0 && has_value) {
+            if (!parse_format(argv[++i], &options->input_format) ||
+                options->input_format == FORMAT_GRID) {
+                return false;
+            }
+        } else if (strcmp(argv[i], "--out") == 0 && has_value) {
+            options->output_path = argv[++i];
+        } else if (strcmp(argv[i], "--walls") == 0 && generating) {
+            options->walls = true;
+        } else if (argv[i][0] != '-' && generating && !options->num_puzzles) {
+            if (!parse_count(argv[i], UINT64_MAX, &options->num_puzzles)) {
+                return false;
+            }
+        } else if ((argv[i][0] != '-' || strcmp(argv[i], "-") == 0) && !generating &&
+                   !options->input_path) {
+            options->input_path = argv[i];
+        } else {
+            return false;
         }
+    }
+    if (!options->max_solutions) {
+        u64 limit = solve_mode_limit(options->mode);
+        options->max_solutions = limit ? limit : CLI_DEFAULT_MAX_SOLUTIONS;
+    }
+    return !generating || options->num_puzzles;
+}
 
-        // @opt(steve): Broken out so they're easier to debug. Ideally should short circuit.
-        bool invalid_monster = !is_invalid_monster(puzzle, solution, pos_from_slot(slot));
-        bool overlap = check_doesnt_overlap(puzzle, solution);
-        bool dead_ends = check_dead_ends(puzzle, solution, slot);
-        bool monsters = check_monsters(puzzle, solution, slot);
-        bool wide_space = check_wide_space(puzzle, solution, slot);
-        bool treasure = check_treasure_rooms(puzzle, solution, slot);
+// Open the input and output files from the options, stdin and stdout if they aren't set.
+bool cli_open(const CliOptions *options, RecordReader *reader, FILE **output) {
+    *reader = (RecordReader){.file = stdin, .path = "stdin", .format = options->input_format};
+    *output = stdout;
+    if (options->input_path && strcmp(options->input_path, "-") != 0) {
+        reader->path = options->input_path;
+        reader->file = fopen(options->input_path,
+                             options->input_format == FORMAT_BINARY ? "rb" : "r");
+        if (!reader->file) {
+            fprintf(stderr, "could not open %s\n", options->input_path);
+            return false;
+        }
+    }
+    if (options->output_path) {
+        *output = fopen(options->output_path, options->format == FORMAT_BINARY ? "wb" : "w");
+        if (!*output) {
+            fprintf(stderr, "could not create %s\n", options->output_path);
+            if (reader->file != stdin) {
+                fclose(reader->file);
+            }
+            return false;
+        }
+    }
+#if defined(_WIN32)
+    // stdin and stdout translate newlines unless they're switched to binary.
+    if (reader->file == stdin && options->input_format == FORMAT_BINARY) {
+        _setmode(_fileno(stdin), _O_BINARY);
+    }
+    if (*output == stdout && options->format == FORMAT_BINARY) {
+        _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+    return true;
+}
 
-        // Check constraints.
-        if (invalid_monster && overlap && dead_ends && monsters && wide_space && treasure) {
+// Close the files from `cli_open`. Returns false if the output couldn't be written.
+bool cli_close(RecordReader *reader, FILE *output) {
+    if (reader->file != stdin) {
+        fclose(reader->file);
+    }
+    return output == stdout ? fflush(output) == 0 : fclose(output) == 0;
+}
 
-            // Move on to the next slot.
-            if (slot < 63) {
-                slot++;
+// dandd solve [input] [--mode all|first|unique] [--max-solutions n] [--threads n]
+//             [--input-format text|binary] [--format text|binary|grid] [--out file]
+// Writes a record for every solution found, or one with no solution if there aren't any.
+int solve_main(int argc, char **argv) {
+    CliOptions options;
+    if (!parse_cli_options(argc, argv, false, &options)) {
+        fprintf(stderr, "usage: dandd solve [input] [--mode all|first|unique] "
+                        "[--max-solutions n] [--threads n] [--input-format text|binary] "
+                        "[--format text|binary|grid] [--out file]\n");
+        return 1;
+    }
+    RecordReader reader;
+    FILE *output;
+    if (!cli_open(&options, &reader, &output)) {
+        return 1;
+    }
+    GeneratedPuzzle *records = malloc(CLI_BATCH_SIZE * sizeof(GeneratedPuzzle));
+    Puzzle *puzzles = malloc(CLI_BATCH_SIZE * sizeof(Puzzle));
+    SolveResult *results = malloc(CLI_BATCH_SIZE * sizeof(SolveResult));
+    u64 *solutions = malloc((size_t)(CLI_BATCH_SIZE * options.max_solutions) * sizeof(u64));
+    OutputBuffer out = {0};
+    bool ok = records && puzzles && results && solutions;
+    if (!ok) {
+        fprintf(stderr, "out of memory\n");
+    }
+    while (ok) {
+        i64 len = read_batch(&reader, records);
+        if (len <= 0) {
+            ok = len == 0;
+            break;
+        }
+        for (i64 i = 0; i < len; i++) {
+            puzzles[i] = records[i].puzzle;
+        }
+        solve_batch(puzzles, (u64)len, solutions, options.max_solutions, options.mode, results,
+                    options.num_threads);
+        for (i64 i = 0; i < len; i++) {
+            GeneratedPuzzle record = {.puzzle = puzzles[i],
+                                      .num_solutions = results[i].num_solutions};
+            u64 num_recorded = results[i].hit_max ? options.max_solutions : record.num_solutions;
+            if (!num_recorded) {
+                output_record(&out, options.format, record);
+            }
+            for (u64 j = 0; j < num_recorded; j++) {
+                record.solution = solutions[(u64)i * options.max_solutions + j];
+                output_record(&out, options.format, record);
+            }
+        }
+        if (!output_flush(&out, output)) {
+            fprintf(stderr, "could not write the output\n");
+            ok = false;
+        }
+    }
+    free(out.data);
+    free(solutions);
+    free(results);
+    free(puzzles);
+    free(records);
+    return cli_close(&reader, output) && ok ? 0 : 1;
+}
+
+// The puzzles for `generate`, written out CLI_BATCH_SIZE at a time as they're generated.
+typedef struct {
+    OutputBuffer out;
+    FILE *output;
+    Format format;
+    u64 num_puzzles;
+    u64 max_puzzles;
+    bool failed;
+} GenerateOutput;
+
+bool output_generated_puzzle(void *userdata, GeneratedPuzzle puzzle) {
+    GenerateOutput *generated = userdata;
+    output_record(&generated->out, generated->format, puzzle);
+    generated->num_puzzles++;
+    if (generated->num_puzzles % CLI_BATCH_SIZE == 0) {
+        generated->failed = !output_flush(&generated->out, generated->output);
+    }
+    return generated->num_puzzles < generated->max_puzzles && !generated->failed;
+}
+
+// dandd generate <num_puzzles> [--walls] [--threads n] [--format text|binary|grid] [--out file]
+// `--walls` uses `generate_walls`, which only runs on one thread.
+int generate_main(int argc, char **argv) {
+    CliOptions options;
+    if (!parse_cli_options(argc, argv, true, &options)) {
+        fprintf(stderr, "usage: dandd generate <num_puzzles> [--walls] [--threads n] "
+                        "[--format text|binary|grid] [--out file]\n");
+        return 1;
+    }
+    RecordReader reader;
+    options.input_path = NULL;
+    GenerateOutput generated = {.format = options.format, .max_puzzles = options.num_puzzles};
+    if (!cli_open(&options, &reader, &generated.output)) {
+        return 1;
+    }
+    if (options.walls) {
+        generate_walls_each(output_generated_puzzle, &generated);
+    } else {
+        generate_parallel_each(output_generated_puzzle, &generated, options.num_threads);
+    }
+    bool ok = !generated.failed && output_flush(&generated.out, generated.output);
+    if (!ok) {
+        fprintf(stderr, "could not write the output\n");
+    }
+    free(generated.out.data);
+    return cli_close(&reader, generated.output) && ok ? 0 : 1;
+}
+
+typedef struct {
+    const GeneratedPuzzle *records;
+    u64 num_records;
+    u64 *invalid_cells;
+} ValidateBatch;
+
+void validate_batch_task(void *context, u64 task, i32 worker) {
+    (void)worker;
+    ValidateBatch *batch = context;
+    u64 end = (task + 1) * SOLVE_BATCH_CHUNK;
+    for (u64 i = task * SOLVE_BATCH_CHUNK; i < end && i < batch->num_records; i++) {
+        batch->invalid_cells[i] =
+            validate_solution_cells(&batch->records[i].puzzle, batch->records[i].solution);
+    }
+}
+
+// dandd validate [input] [--threads n] [--input-format text|binary] [--format text|binary|grid]
+//                [--out file]
+// Checks the solution in each record. Text output is the record's puzzle line and solution, then
+// `ok` or `invalid` and the cells that break a rule in hex. Binary output is those cells as a
+// little endian u64 for each record, 0 if it's valid. Exits with 1 if any solution isn't valid.
+int validate_main(int argc, char **argv) {
+    CliOptions options;
+    if (!parse_cli_options(argc, argv, false, &options)) {
+        fprintf(stderr, "usage: dandd validate [input] [--threads n] "
+                        "[--input-format text|binary] [--format text|binary|grid] [--out file]\n");
+        return 1;
+    }
+    RecordReader reader;
+    FILE *output;
+    if (!cli_open(&options, &reader, &output)) {
+        return 1;
+    }
+    init_masks();
+    GeneratedPuzzle *records = malloc(CLI_BATCH_SIZE * sizeof(GeneratedPuzzle));
+    u64 *invalid_cells = malloc(CLI_BATCH_SIZE * sizeof(u64));
+    OutputBuffer out = {0};
+    bool ok = records && invalid_cells;
+    bool all_valid = true;
+    if (!ok) {
+        fprintf(stderr, "out of memory\n");
+    }
+    while (ok) {
+        i64 len = read_batch(&reader, records);
+        if (len <= 0) {
+            ok = len == 0;
+            break;
+        }
+        ValidateBatch batch = {
+            .records = records, .num_records = (u64)len, .invalid_cells = invalid_cells};
+        u64 num_tasks = ((u64)len + SOLVE_BATCH_CHUNK - 1) / SOLVE_BATCH_CHUNK;
+        if (options.num_threads <= 1 || num_tasks <= 1 ||
+            !run_tasks(num_tasks, options.num_threads, validate_batch_task, &batch)) {
+            for (u64 task = 0; task < num_tasks; task++) {
+                validate_batch_task(&batch, task, 0);
+            }
+        }
+        for (i64 i = 0; i < len; i++) {
+            u64 invalid = invalid_cells[i];
+            all_valid = all_valid && !invalid;
+            if (options.format == FORMAT_BINARY) {
+                u8 *dest = (u8 *)output_reserve(&out, 8);
+                if (dest) {
+                    put_u64(dest, invalid);
+                }
                 continue;
             }
+            char line[64];
+            if (options.format == FORMAT_GRID) {
+                char *dest = output_reserve(&out, PUZZLE_GRID_LEN);
+                if (dest) {
+                    format_puzzle_grid(dest, records[i].puzzle, records[i].solution);
+                }
+            } else {
+                output_puzzle_line(&out, records[i].puzzle);
+                snprintf(line, sizeof(line), " %016" PRIx64 " ", records[i].solution);
+                output_string(&out, line);
+            }
+            if (invalid) {
+                snprintf(line, sizeof(line), "invalid %016" PRIx64 "\n", invalid);
+            } else {
+                snprintf(line, sizeof(line), "ok\n");
+            }
+            output_string(&out, line);
+            if (options.format == FORMAT_GRID) {
+                output_string(&out, "\n");
+            }
+        }
+        if (!output_flush(&out, output)) {
+            fprintf(stderr, "could not write the output\n");
+            ok = false;
+        }
+    }
+    free(out.data);
+    free(invalid_cells);
+    free(records);
+    return cli_close(&reader, output) && ok && all_valid ? 0 : 1;
+}
+
+// Distributed enumeration.
+// `dandd enumerate --shard i --shards n` splits the units up between machines ahead of time, so
+// the job isn't done until the slowest machine finishes its share. `dandd coordinate` and
+// `dandd worker` hand the units out one at a time instead, through a directory that every node can
+// see (on a network file system), so nodes can come and go and the faster ones do more of the work.
+// A work unit is every puzzle whose first `depth` tiles are one of the prefixes from
+// `generate_prefixes_to`, written as its number and its tiles, `.` for empty, `X` for a wall, `M`
+// for a monster and `T` for a treasure, like `12 ..X.M.XX.X.M`. In the directory:
+// * `units` is the plan, a unit per line, numbered in the order the generator finds them.
+// * `unit-N.claim` is created when unit N is handed out, only if it doesn't already exist, so a
+//   unit is only handed out once. It's `owner time`, the node, process and thread that has the
+//   unit and when (in seconds since the epoch) it last renewed its lease on it. Workers renew it
+//   whenever they checkpoint, and `coordinate next --reclaim` only hands a unit out again once its
+//   lease has run out. A worker checks that it still holds the claim before every write, and stops
+//   working on the unit if it doesn't. `units.next` remembers where to start looking for the next
+//   unit.
+// * `unit-N.ckpt` is the worker's checkpoint, the same as `enumerate`'s, and `unit-N.bin` holds the
+//   unit's puzzles as binary records (see `PuzzleRecord`).
+// * `unit-N.result` is `N tiles num_puzzles num_unique hash`, written last when the unit is
+//   finished, where hash is the FNV-1a hash of `unit-N.bin`.
+// The generator is deterministic and a unit only depends on its prefix, so merging the units in
+// order gives the same puzzles in the same order as `generate`, whichever nodes did which units.
+
+#define WORK_DEFAULT_DEPTH 12
+// How long a claim lasts after it was last renewed. Workers renew their claims every time they
+// checkpoint, so it should be a lot longer than their `--every`.
+#define WORK_DEFAULT_LEASE_SECONDS 3600
+
+typedef struct {
+    u64 number;
+    // The unit is every puzzle with these first `depth` tiles.
+    i32 depth;
+    Tile prefix[64];
+} WorkUnit;
+
+typedef struct {
+    u64 num_puzzles;
+    u64 num_unique;
+    u64 hash;
+} WorkResult;
+
+// Indexed by Tile.
+static const char work_tile_chars[] = ".XMT";
+
+// The unit as a line, `number tiles` without a newline. `line` needs room for 86 chars.
+void work_unit_format(const WorkUnit *unit, char *line, u64 line_len) {
+    char tiles[65];
+    for (i32 i = 0; i < unit->depth; i++) {
+        tiles[i] = work_tile_chars[unit->prefix[i]];
+    }
+    tiles[unit->depth] = '\0';
+    snprintf(line, (size_t)line_len, "%" PRIu64 " %s", unit->number, tiles);
+}
+
+// Returns false if `number` and `tiles` aren't a unit.
+bool work_unit_parse(const char *number, const char *tiles, WorkUnit *unit) {
+    char *end;
+    unit->number = strtoull(number, &end, 10);
+    u64 depth = strlen(tiles);
+    if (end == number || *end != '\0' || depth == 0 || depth >= 64) {
+        return false;
+    }
+    unit->depth = (i32)depth;
+    for (i32 i = 0; i < unit->depth; i++) {
+        const char *tile = strchr(work_tile_chars, tiles[i]);
+        if (!tile) {
+            return false;
+        }
+        unit->prefix[i] = (Tile)(tile - work_tile_chars);
+    }
+    return true;
+}
+
+void work_path(const char *dir, u64 number, const char *extension, char *path, u64 path_len) {
+    snprintf(path, (size_t)path_len, "%s/unit-%06" PRIu64 ".%s", dir, number, extension);
+}
+
+typedef struct {
+    char owner[128];
+    u64 time;
+} WorkClaim;
+
+// Who a claim is for, `host:process:worker`.
+void work_owner(char *owner, u64 owner_len, i32 worker) {
+    char host[64] = "unknown";
+#if defined(_WIN32)
+    DWORD host_len = sizeof(host);
+    if (!GetComputerNameA(host, &host_len)) {
+        strcpy(host, "unknown");
+    }
+#else
+    if (gethostname(host, sizeof(host)) != 0) {
+        strcpy(host, "unknown");
+    }
+    host[sizeof(host) - 1] = '\0';
+#endif
+    snprintf(owner, (size_t)owner_len, "%s:%" PRIu64 ":%" PRIi32, host, process_id(), worker);
+}
+
+// Returns false if the unit hasn't been claimed or the claim can't be read.
+bool work_claim_load(const char *dir, u64 number, WorkClaim *claim) {
+    char path[1024];
+    work_path(dir, number, "claim", path, sizeof(path));
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    bool ok = fscanf(file, "%127s %" SCNu64, claim->owner, &claim->time) == 2;
+    fclose(file);
+    return ok;
+}
+
+// Write a claim on the unit for `owner` as of now. With `replace` it takes over (or renews) any
+// claim that's already there, otherwise it fails if the unit has already been claimed.
+bool work_claim_write(const char *dir, u64 number, const char *owner, bool replace) {
+    char path[1024];
+    work_path(dir, number, "claim", path, sizeof(path));
+    char line[256];
+    int len = snprintf(line, sizeof(line), "%s %" PRIu64 "\n", owner, (u64)time(NULL));
+    if (len < 0 || (u64)len >= sizeof(line)) {
+        return false;
+    }
+    return replace ? write_file_replacing(path, line, (u64)len)
+                   : write_file_once(path, line, (u64)len);
+}
 
-            // This is a valid puzzle!
-            // Record it but don't increment slot, we want to backtrack and keep searching for
-            // more.
-            Puzzle valid_puzzle = {.row_wall_counts = {0, 0, 0, 0, 0, 0, 0},
-                                   .col_wall_counts = {0, 0, 0, 0, 0, 0, 0},
-                                   .monsters = puzzle.monsters,
-                                   .treasures = puzzle.treasures};
-            // Calculate row and col counts.
-            for (i32 i = 0; i < 8; i++) {
-                valid_puzzle.row_wall_counts[i] = (u8)count_walls_in_row(solution, i);
-                valid_puzzle.col_wall_counts[i] = (u8)count_walls_in_col(solution, i);
+// Whether `owner` still holds the claim on the unit.
+bool work_claim_held(const char *dir, u64 number, const char *owner) {
+    WorkClaim claim;
+    return work_claim_load(dir, number, &claim) && strcmp(claim.owner, owner) == 0;
+}
+
+bool truncate_file(FILE *file, u64 size) {
+#if defined(_WIN32)
+    return _chsize_s(_fileno(file), (__int64)size) == 0;
+#else
+    return ftruncate(fileno(file), (off_t)size) == 0;
+#endif
+}
+
+// Read the plan in `dir`. Returns NULL (after printing why) if there isn't one or it isn't valid,
+// otherwise the caller frees it.
+WorkUnit *work_load_plan(const char *dir, u64 *num_units) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/units", dir);
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "could not open %s, run `dandd coordinate %s plan` first\n", path, dir);
+        return NULL;
+    }
+    WorkUnit *units = NULL;
+    u64 units_cap = 0;
+    *num_units = 0;
+    bool ok = true;
+    char line[256];
+    while (ok && fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+            continue;
+        }
+        if (*num_units == units_cap) {
+            units_cap = units_cap ? units_cap * 2 : 1024;
+            WorkUnit *grown = realloc(units, (size_t)units_cap * sizeof(WorkUnit));
+            if (!grown) {
+                fprintf(stderr, "out of memory\n");
+                ok = false;
+                break;
             }
-            // Check number of solutions.
-            u64 valid_puzzle_solutions[128];
-            u64 num_valid_puzzle_solutions = solve(valid_puzzle, valid_puzzle_solutions, 128);
+            units = grown;
+        }
+        char number[32];
+        char tiles[65];
+        WorkUnit *unit = &units[*num_units];
+        ok = sscanf(line, "%31s %64s", number, tiles) == 2 &&
+             work_unit_parse(number, tiles, unit) && unit->number == *num_units &&
+             unit->depth == units[0].depth;
+        if (!ok) {
+            fprintf(stderr, "%s: unit %" PRIu64 " isn't valid\n", path, *num_units);
+        }
+        (*num_units)++;
+    }
+    fclose(file);
+    if (ok && *num_units == 0) {
+        fprintf(stderr, "%s doesn't have any units\n", path);
+        ok = false;
+    }
+    if (!ok) {
+        free(units);
+        return NULL;
+    }
+    return units;
+}
 
-#if 0
-            // @note(steve): Good place to debug stuff. For example this code looks at puzzles with more than one solution.
-            if (num_valid_puzzle_solutions != 1) {
-                printf("found puzzle with %" PRIu64 " solutions\n", num_valid_puzzle_solutions);
-                printf("Generated Solution\n");
-                print_puzzle(valid_puzzle, solution);
-                printf("Solver Solution 0\n");
-                print_puzzle(valid_puzzle, valid_puzzle_solutions[0]);
-                printf("Solver Solution 1\n");
-                print_puzzle(valid_puzzle, valid_puzzle_solutions[1]);
-            }
-#endif
-
-            GeneratedPuzzle gen_puzzle = {.puzzle = valid_puzzle,
-                                          .num_solutions = num_valid_puzzle_solutions};
-            if (puzzle_i < max_puzzles) {
-                puzzles[puzzle_i++] = gen_puzzle;
-            } else {
-                // @note(Steve): Just stopping when the buffer is full, I haven't tried generating
-                // or counting them all.
-                return puzzle_i;
+// Returns false if the unit isn't finished.
+bool work_load_result(const char *dir, const WorkUnit *unit, WorkResult *result) {
+    char path[1024];
+    work_path(dir, unit->number, "result", path, sizeof(path));
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    char line[256];
+    char number[32];
+    char tiles[65];
+    WorkUnit read;
+    bool ok = fgets(line, sizeof(line), file) &&
+              sscanf(line, "%31s %64s %" SCNu64 " %" SCNu64 " %" SCNx64, number, tiles,
+                     &result->num_puzzles, &result->num_unique, &result->hash) == 5 &&
+              work_unit_parse(number, tiles, &read) && read.number == unit->number &&
+              read.depth == unit->depth &&
+              memcmp(read.prefix, unit->prefix, (size_t)unit->depth * sizeof(Tile)) == 0;
+    fclose(file);
+    return ok;
+}
+
+// Claim the first unit that hasn't been handed out for `owner`. Returns false if they all have.
+bool work_claim_next(const char *dir, const WorkUnit *units, u64 num_units, const char *owner,
+                     u64 *claimed) {
+    char next_path[1024];
+    snprintf(next_path, sizeof(next_path), "%s/units.next", dir);
+    // Every unit before the one in `units.next` has been claimed, since claims are never removed.
+    // It's only a hint, it's fine if another node moves it back.
+    u64 first = 0;
+    FILE *next = fopen(next_path, "r");
+    if (next) {
+        if (fscanf(next, "%" SCNu64, &first) != 1) {
+            first = 0;
+        }
+        fclose(next);
+    }
+    for (u64 i = first; i < num_units; i++) {
+        if (work_claim_write(dir, units[i].number, owner, false)) {
+            char line[32];
+            int len = snprintf(line, sizeof(line), "%" PRIu64 "\n", i + 1);
+            write_file_replacing(next_path, line, (u64)len);
+            *claimed = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Generate every puzzle in the unit into `unit-N.bin`, picking up from its checkpoint if there is
+// one, and write its result, as `owner`. Takes over the unit's claim if someone else has it.
+// Returns false (after printing why) if it couldn't be finished, or the unit was handed out to
+// someone else part way through.
+bool work_run_unit(const char *dir, const WorkUnit *unit, u64 checkpoint_ns, const char *owner) {
+    WorkResult result;
+    if (work_load_result(dir, unit, &result)) {
+        return true;
+    }
+    if (!work_claim_held(dir, unit->number, owner) &&
+        !work_claim_write(dir, unit->number, owner, true)) {
+        fprintf(stderr, "could not claim unit %" PRIu64 "\n", unit->number);
+        return false;
+    }
+    char path[1024];
+    char checkpoint_path[1024];
+    char bin_path[1024];
+    work_path(dir, unit->number, "ckpt", checkpoint_path, sizeof(checkpoint_path));
+    work_path(dir, unit->number, "bin", bin_path, sizeof(bin_path));
+
+    Checkpoint checkpoint = {.unit = unit->number};
+    bool exists = false;
+    bool resumed = checkpoint_load(checkpoint_path, &checkpoint, &exists);
+    FILE *file;
+    if (exists) {
+        bool same = resumed && checkpoint.unit == unit->number &&
+                    checkpoint.state.first_slot == unit->depth && checkpoint.state.end_slot == 64 &&
+                    memcmp(checkpoint.state.puzzle_tiles, unit->prefix,
+                           (size_t)unit->depth * sizeof(Tile)) == 0;
+        if (!same) {
+            fprintf(stderr, "checkpoint %s is corrupt or doesn't match unit %" PRIu64 "\n",
+                    checkpoint_path, unit->number);
+            return false;
+        }
+        // Drop any puzzles written after the checkpoint, they'll be found again.
+        file = fopen(bin_path, "r+b");
+        if (file && (!truncate_file(file, checkpoint.num_puzzles * sizeof(PuzzleRecord)) ||
+                     fseek(file, 0, SEEK_END) != 0)) {
+            fclose(file);
+            file = NULL;
+        }
+    } else {
+        gen_init(&checkpoint.state, unit->prefix, unit->depth, 64);
+        file = fopen(bin_path, "wb");
+    }
+    if (!file) {
+        fprintf(stderr, "could not write %s\n", bin_path);
+        return false;
+    }
+
+    OutputBuffer out = {0};
+    bool ok = true;
+    bool lost = false;
+    u64 last_save = now_ns();
+    while (ok && !checkpoint.finished) {
+        bool found = gen_next(&checkpoint.state);
+        if (found) {
+            GeneratedPuzzle puzzle = gen_puzzle(&checkpoint.state);
+            output_record(&out, FORMAT_BINARY, puzzle);
+            checkpoint.num_puzzles++;
+            checkpoint.num_unique += puzzle.num_solutions == 1;
+        }
+        checkpoint.finished = !found;
+        // Write out every full batch, and checkpoint (and renew the claim) once `checkpoint_ns`
+        // has passed, which is checked after every puzzle, and at the end.
+        bool save = !found || now_ns() - last_save >= checkpoint_ns;
+        if (save || checkpoint.num_puzzles % CLI_BATCH_SIZE == 0) {
+            lost = !work_claim_held(dir, unit->number, owner);
+            // The puzzles have to be in the file before a checkpoint counts them.
+            ok = !lost && output_flush(&out, file);
+            if (ok && save) {
+                ok = checkpoint_save(checkpoint_path, &checkpoint) &&
+                     work_claim_write(dir, unit->number, owner, true);
+                last_save = now_ns();
             }
         }
+    }
+    free(out.data);
+    ok = fclose(file) == 0 && ok;
+    if (lost) {
+        fprintf(stderr, "unit %" PRIu64 " was handed out again, stopped working on it\n",
+                unit->number);
+        return false;
+    }
+    if (!ok) {
+        fprintf(stderr, "could not write unit %" PRIu64 "\n", unit->number);
+        return false;
+    }
 
-        // Backtrack to the last set slot (which could be this one).
-        while (slot >= 0 && puzzle_tiles[slot] == 0) {
-            slot--;
+    // Hash what's really in the file, so the result vouches for it.
+    file = fopen(bin_path, "rb");
+    u64 len = 0;
+    result = (WorkResult){.num_puzzles = checkpoint.num_puzzles,
+                          .num_unique = checkpoint.num_unique,
+                          .hash = HASH_BYTES_START};
+    u8 buffer[1 << 16];
+    size_t read;
+    while (file && (read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        result.hash = hash_bytes_from(result.hash, buffer, read);
+        len += read;
+    }
+    if (file) {
+        fclose(file);
+    }
+    if (len != result.num_puzzles * sizeof(PuzzleRecord)) {
+        fprintf(stderr, "%s doesn't have the %" PRIu64 " puzzles it should\n", bin_path,
+                result.num_puzzles);
+        return false;
+    }
+    char line[256];
+    work_unit_format(unit, line, sizeof(line));
+    char result_line[384];
+    int result_len = snprintf(result_line, sizeof(result_line),
+                              "%s %" PRIu64 " %" PRIu64 " %016" PRIx64 "\n", line,
+                              result.num_puzzles, result.num_unique, result.hash);
+    // The result is moved into place whole, and only by the worker that holds the claim.
+    work_path(dir, unit->number, "result", path, sizeof(path));
+    if (!work_claim_held(dir, unit->number, owner)) {
+        fprintf(stderr, "unit %" PRIu64 " was handed out again, not writing its result\n",
+                unit->number);
+        return false;
+    }
+    if (!write_file_replacing(path, result_line, (u64)result_len)) {
+        fprintf(stderr, "could not write %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+typedef struct {
+    const char *dir;
+    const WorkUnit *units;
+    u64 num_units;
+    u64 checkpoint_ns;
+    u64 failed;
+    u64 units_done;
+} Worker;
+
+void worker_task(void *context, u64 task, i32 worker_index) {
+    (void)worker_index;
+    Worker *worker = context;
+    char owner[256];
+    work_owner(owner, sizeof(owner), (i32)task);
+    u64 unit;
+    while (!atomic_load_u64(&worker->failed) &&
+           work_claim_next(worker->dir, worker->units, worker->num_units, owner, &unit)) {
+        u64 number = worker->units[unit].number;
+        if (!work_run_unit(worker->dir, &worker->units[unit], worker->checkpoint_ns, owner)) {
+            // A unit that was handed out again is someone else's now, go on to the next one.
+            if (work_claim_held(worker->dir, number, owner)) {
+                atomic_store_u64(&worker->failed, 1);
+                return;
+            }
+            continue;
         }
+        atomic_fetch_add_u64(&worker->units_done, 1);
     }
-    return puzzle_i;
 }
 
-int main(void) {
+// dandd worker <dir> [<number> <tiles>] [--every seconds] [--threads n]
+// With a unit, runs that unit. Without one, claims and runs units until they've all been handed
+// out, on n threads.
+int worker_main(int argc, char **argv) {
+    const char *args[3] = {0};
+    i32 num_args = 0;
+    u64 checkpoint_ns = (u64)ENUMERATE_DEFAULT_SECONDS * 1000000000;
+    i32 num_threads = 1;
+    bool ok = true;
+    for (int i = 0; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--every") == 0 && has_value) {
+            ok = ok && parse_seconds(argv[++i], &checkpoint_ns);
+        } else if (strcmp(argv[i], "--threads") == 0 && has_value) {
+            ok = ok && parse_threads(argv[++i], &num_threads);
+        } else if (argv[i][0] != '-' && num_args < 3) {
+            args[num_args++] = argv[i];
+        } else {
+            ok = false;
+        }
+    }
+    WorkUnit unit;
+    if (!ok || num_args == 0 || num_args == 2 ||
+        (num_args == 3 && !work_unit_parse(args[1], args[2], &unit))) {
+        fprintf(stderr,
+                "usage: dandd worker <dir> [<number> <tiles>] [--every seconds] [--threads n]\n");
+        return 1;
+    }
+    const char *dir = args[0];
+    init_masks();
+    if (num_args == 3) {
+        char owner[256];
+        work_owner(owner, sizeof(owner), 0);
+        return work_run_unit(dir, &unit, checkpoint_ns, owner) ? 0 : 1;
+    }
+
+    Worker worker = {.dir = dir, .checkpoint_ns = checkpoint_ns};
+    WorkUnit *units = work_load_plan(dir, &worker.num_units);
+    if (!units) {
+        return 1;
+    }
+    worker.units = units;
+    if (!run_tasks((u64)num_threads, num_threads, worker_task, &worker)) {
+        worker_task(&worker, 0, 0);
+    }
+    free(units);
+    printf("units finished: %" PRIu64 "\n", worker.units_done);
+    return worker.failed ? 1 : 0;
+}
+
+// Write the plan, every prefix of `depth` tiles as a unit.
+int coordinate_plan(const char *dir, i32 depth) {
+    assert(1 <= depth && depth <= 63);
+    u64 num_units;
+    Tile *prefixes = generate_prefixes_to(depth, &num_units);
+    if (!prefixes) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/units", dir);
+    // Never replace a plan, the units in it could already be handed out.
+    FILE *file = fopen(path, "wx");
+    if (!file) {
+        fprintf(stderr, "could not create %s, or there's already a plan\n", path);
+        free(prefixes);
+        return 1;
+    }
+    bool ok = true;
+    for (u64 i = 0; ok && i < num_units; i++) {
+        WorkUnit unit = {.number = i, .depth = depth};
+        memcpy(unit.prefix, &prefixes[i * (u64)depth], (size_t)depth * sizeof(Tile));
+        char line[256];
+        work_unit_format(&unit, line, sizeof(line));
+        ok = fprintf(file, "%s\n", line) > 0;
+    }
+    ok = fclose(file) == 0 && ok;
+    free(prefixes);
+    if (!ok) {
+        fprintf(stderr, "could not write %s\n", path);
+        return 1;
+    }
+    printf("units: %" PRIu64 "\n", num_units);
+    return 0;
+}
+
+// Print the next unit to run and claim it. With `reclaim`, once every unit has been handed out,
+// hands out the first one that isn't finished and whose claim hasn't been renewed for
+// `lease_seconds` again (for when a node died part way through one). A claim that can't be read
+// counts as run out.
+int coordinate_next(const char *dir, const WorkUnit *units, u64 num_units, bool reclaim,
+                    u64 lease_seconds) {
+    char owner[256];
+    work_owner(owner, sizeof(owner), 0);
+    u64 next;
+    bool found = work_claim_next(dir, units, num_units, owner, &next);
+    u64 now = (u64)time(NULL);
+    for (u64 i = 0; !found && reclaim && i < num_units; i++) {
+        WorkResult result;
+        WorkClaim claim;
+        if (work_load_result(dir, &units[i], &result) ||
+            (work_claim_load(dir, units[i].number, &claim) && claim.time + lease_seconds > now)) {
+            continue;
+        }
+        found = work_claim_write(dir, units[i].number, owner, true);
+        next = i;
+    }
+    if (!found) {
+        fprintf(stderr, reclaim ? "every unit is finished or has a claim that hasn't run out\n"
+                                : "every unit has been handed out\n");
+        return 1;
+    }
+    char line[256];
+    work_unit_format(&units[next], line, sizeof(line));
+    printf("%s\n", line);
+    return 0;
+}
+
+int coordinate_status(const char *dir, const WorkUnit *units, u64 num_units) {
+    u64 num_finished = 0;
+    u64 num_claimed = 0;
+    u64 num_puzzles = 0;
+    u64 num_unique = 0;
+    char path[1024];
+    for (u64 i = 0; i < num_units; i++) {
+        WorkResult result;
+        if (work_load_result(dir, &units[i], &result)) {
+            num_finished++;
+            num_puzzles += result.num_puzzles;
+            num_unique += result.num_unique;
+        } else {
+            work_path(dir, units[i].number, "claim", path, sizeof(path));
+            num_claimed += file_exists(path);
+        }
+    }
+    printf("units: %" PRIu64 " of %" PRIu64 " finished, %" PRIu64 " running\n", num_finished,
+           num_units, num_claimed);
+    printf("puzzles: %" PRIu64 "\n", num_puzzles);
+    printf("unique puzzles: %" PRIu64 "\n", num_unique);
+    return 0;
+}
+
+// Concatenate every unit's puzzles, in order, into one file of binary records, checking each one
+// against its result.
+int coordinate_merge(const char *dir, const WorkUnit *units, u64 num_units, const char *out_path) {
+    FILE *out = fopen(out_path, "wb");
+    if (!out) {
+        fprintf(stderr, "could not create %s\n", out_path);
+        return 1;
+    }
+    u64 num_puzzles = 0;
+    u64 num_unique = 0;
+    u64 hash = HASH_BYTES_START;
+    bool ok = true;
+    u8 *buffer = malloc(1 << 20);
+    if (!buffer) {
+        fprintf(stderr, "out of memory\n");
+        ok = false;
+    }
+    char path[1024];
+    for (u64 i = 0; ok && i < num_units; i++) {
+        WorkResult result;
+        if (!work_load_result(dir, &units[i], &result)) {
+            fprintf(stderr, "unit %" PRIu64 " isn't finished\n", units[i].number);
+            ok = false;
+            break;
+        }
+        work_path(dir, units[i].number, "bin", path, sizeof(path));
+        FILE *file = fopen(path, "rb");
+        u64 unit_hash = HASH_BYTES_START;
+        u64 len = 0;
+        size_t read;
+        while (ok && file && (read = fread(buffer, 1, 1 << 20, file)) > 0) {
+            unit_hash = hash_bytes_from(unit_hash, buffer, read);
+            hash = hash_bytes_from(hash, buffer, read);
+            len += read;
+            ok = fwrite(buffer, 1, read, out) == read;
+        }
+        if (file) {
+            fclose(file);
+        }
+        if (!ok) {
+            fprintf(stderr, "could not write %s\n", out_path);
+        } else if (len != result.num_puzzles * sizeof(PuzzleRecord) || unit_hash != result.hash) {
+            fprintf(stderr, "%s doesn't match its result\n", path);
+            ok = false;
+        }
+        num_puzzles += result.num_puzzles;
+        num_unique += result.num_unique;
+    }
+    free(buffer);
+    ok = fclose(out) == 0 && ok;
+    if (!ok) {
+        remove(out_path);
+        return 1;
+    }
+    printf("puzzles: %" PRIu64 "\n", num_puzzles);
+    printf("unique puzzles: %" PRIu64 "\n", num_unique);
+    printf("hash: %016" PRIx64 "\n", hash);
+    return 0;
+}
+
+// dandd coordinate <dir> plan [--depth d]
+// dandd coordinate <dir> next [--reclaim] [--lease seconds]
+// dandd coordinate <dir> status
+// dandd coordinate <dir> merge <out>
+int coordinate_main(int argc, char **argv) {
+    u64 depth = WORK_DEFAULT_DEPTH;
+    bool plan = argc >= 2 && strcmp(argv[1], "plan") == 0 &&
+                (argc == 2 || (argc == 4 && strcmp(argv[2], "--depth") == 0 &&
+                               parse_count(argv[3], 63, &depth) && depth >= 1));
+    bool next = argc >= 2 && strcmp(argv[1], "next") == 0;
+    bool reclaim = false;
+    u64 lease_seconds = WORK_DEFAULT_LEASE_SECONDS;
+    for (int i = 2; next && i < argc; i++) {
+        if (strcmp(argv[i], "--reclaim") == 0) {
+            reclaim = true;
+        } else {
+            next = strcmp(argv[i], "--lease") == 0 && i + 1 < argc &&
+                   parse_count(argv[++i], UINT32_MAX, &lease_seconds) && lease_seconds >= 1;
+        }
+    }
+    bool status = argc == 2 && strcmp(argv[1], "status") == 0;
+    bool merge = argc == 3 && strcmp(argv[1], "merge") == 0;
+    if (!plan && !next && !status && !merge) {
+        fprintf(stderr, "usage: dandd coordinate <dir> plan [--depth d]\n"
+                        "       dandd coordinate <dir> next [--reclaim] [--lease seconds]\n"
+                        "       dandd coordinate <dir> status\n"
+                        "       dandd coordinate <dir> merge <out>\n");
+        return 1;
+    }
+    if (plan) {
+        init_masks();
+        return coordinate_plan(argv[0], (i32)depth);
+    }
+    u64 num_units;
+    WorkUnit *units = work_load_plan(argv[0], &num_units);
+    if (!units) {
+        return 1;
+    }
+    int code = next     ? coordinate_next(argv[0], units, num_units, reclaim, lease_seconds)
+               : status ? coordinate_status(argv[0], units, num_units)
+                        : coordinate_merge(argv[0], units, num_units, argv[2]);
+    free(units);
+    return code;
+}
+
+// The bigger board kernels are their own copy of the rules, so main checks every size against
+// `solve`. An 8x8 puzzle put anywhere on a bigger board with walls in every other cell (so those
+// rows and columns need all their cells as walls) has the same solutions, in the same order.
+#define DEFINE_BOARD_SIZE_CHECK(N)                                                                 \
+Board##N board##N##_embed(u64 board, i32 top, i32 left) {                                          \
+    Board##N big = {0};                                                                            \
+    for (i32 slot = 0; slot < 64; slot++) {                                                        \
+        if (slot_is_set(board, slot)) {                                                            \
+            big = board##N##_set(big, (top + slot / 8) * N + left + slot % 8);                     \
+        }                                                                                          \
+    }                                                                                              \
+    return big;                                                                                    \
+}                                                                                                  \
+                                                                                                   \
+bool check_##N##x##N(Puzzle puzzle, i32 top, i32 left) {                                           \
+    board##N##_init_masks();                                                                       \
+    Puzzle##N big = {.monsters = board##N##_embed(puzzle.monsters, top, left),                     \
+                     .treasures = board##N##_embed(puzzle.treasures, top, left)};                  \
+    Board##N outside = board##N##_andnot(board##N##_cells, board##N##_embed(~(u64)0, top, left));  \
+    for (i32 i = 0; i < N; i++) {                                                                  \
+        big.row_wall_counts[i] = N;                                                                \
+        big.col_wall_counts[i] = N;                                                                \
+    }                                                                                              \
+    for (i32 i = 0; i < 8; i++) {                                                                  \
+        big.row_wall_counts[top + i] = (u8)(N - 8 + puzzle.row_wall_counts[i]);                    \
+        big.col_wall_counts[left + i] = (u8)(N - 8 + puzzle.col_wall_counts[i]);                   \
+    }                                                                                              \
+    u64 solutions[4];                                                                              \
+    Board##N big_solutions[4];                                                                     \
+    SolveResult result = solve(puzzle, solutions, 4, SOLVE_ALL);                                   \
+    SolveResult big_result = solve_##N##x##N(big, big_solutions, 4, SOLVE_ALL);                    \
+    if (result.num_solutions != big_result.num_solutions ||                                        \
+        result.hit_max != big_result.hit_max) {                                                    \
+        return false;                                                                              \
+    }                                                                                              \
+    for (u64 i = 0; i < result.num_solutions && i < 4; i++) {                                      \
+        Board##N expected = board##N##_or(outside, board##N##_embed(solutions[i], top, left));     \
+        if (!board##N##_equal(big_solutions[i], expected)) {                                       \
+            return false;                                                                          \
+        }                                                                                          \
+    }                                                                                              \
+    return true;                                                                                   \
+}
+
+BOARD_SIZES(DEFINE_BOARD_SIZE_CHECK)
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return bench(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "enumerate") == 0) {
+        return enumerate_main(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "db") == 0) {
+        return db_main(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "solve") == 0) {
+        return solve_main(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "generate") == 0) {
+        return generate_main(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "validate") == 0) {
+        return validate_main(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "coordinate") == 0) {
+        return coordinate_main(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "worker") == 0) {
+        return worker_main(argc - 2, argv + 2);
+    }
+
     PuzzleArgs args = {.row_wall_counts = {1, 4, 3, 2, 4, 5, 3, 3},
                        .col_wall_counts = {1, 3, 6, 2, 4, 2, 3, 4},
                        .monsters = {{.row = 7, .col = 5}},
@@ -589,13 +7352,51 @@ int main(void) {
                        .treasures_count = 0};
     Puzzle p = puzzle(args);
     u64 solutions[32];
-    u64 num_solutions = solve(p, solutions, 32);
-    printf("num solutions: %" PRIu64 "\n", num_solutions);
-    for (u64 i = 0; i < num_solutions; i++) {
+    SolveResult result = solve(p, solutions, 32, SOLVE_ALL);
+    printf("num solutions: %" PRIu64 "\n", result.num_solutions);
+    if (result.hit_max) {
+        printf("Hit max solutions, only recorded the first 32.\n");
+    }
+    for (u64 i = 0; i < result.num_solutions && i < 32; i++) {
         printf("Solution %" PRIu64 "\n", i);
         print_puzzle(p, solutions[i]);
     }
 
+    u64 parallel_solutions[32];
+    u64 num_parallel_solutions =
+        solve_parallel(p, parallel_solutions, 32, SOLVE_ALL, 4).num_solutions;
+    printf("num solutions (4 threads): %" PRIu64 "\n", num_parallel_solutions);
+
+    u64 row_solutions[32];
+    u64 num_row_solutions = solve_rows(p, row_solutions, 32, SOLVE_ALL).num_solutions;
+    printf("num solutions (rows): %" PRIu64 "\n", num_row_solutions);
+
+    u64 propagate_solutions[32];
+    u64 num_propagate_solutions =
+        solve_propagate(p, propagate_solutions, 32, SOLVE_ALL).num_solutions;
+    printf("num solutions (propagate): %" PRIu64 "\n", num_propagate_solutions);
+    printf("num solutions (counted): %" PRIu64 "\n", count_solutions(p));
+
+    // A 10x10 maze with a treasure room in the top left.
+    Board10 big_solution;
+    Puzzle10 big = puzzle10_from_tiles(".....X..MX"
+                                       ".T.X.X.XXX"
+                                       "...X.X...X"
+                                       "XXXX.XXX.X"
+                                       "..MX...X.X"
+                                       ".XXXXX.X.X"
+                                       "....MX...X"
+                                       ".X.XXXXX.X"
+                                       "MX.......X"
+                                       "XXXXXXXXXX",
+                                       &big_solution);
+    Board10 big_solutions[2];
+    SolveResult big_result = solve_10x10(big, big_solutions, 2, SOLVE_UNIQUE);
+    printf("num solutions (10x10): %" PRIu64 "%s\n", big_result.num_solutions,
+           big_result.num_solutions == 1 && board10_equal(big_solutions[0], big_solution)
+               ? ""
+               : " (wrong)");
+
     printf("\nGenerating first 8 Puzzles\n");
 
     // @note(steve): There are a TON of puzzles. I haven't tried counting them all I suspect it'd
@@ -609,4 +7410,124 @@ int main(void) {
         print_puzzle(puzzles[i].puzzle, 0);
         printf("\n");
     }
+
+    GeneratedPuzzle parallel_puzzles[8];
+    u64 num_parallel_puzzles = generate_parallel(parallel_puzzles, 8, 4);
+    printf("Num generated puzzles (4 threads): %" PRIu64 "\n", num_parallel_puzzles);
+
+    GeneratedPuzzle wall_puzzles[8];
+    u64 num_wall_puzzles = generate_walls(wall_puzzles, 8);
+    printf("Num generated puzzles (walls first): %" PRIu64 "\n", num_wall_puzzles);
+
+    // The lane solver has to find the same solutions as solving the puzzles one at a time.
+    Puzzle batch_puzzles[16];
+    u64 num_batch_puzzles = 0;
+    for (u64 i = 0; i < num_puzzles; i++) {
+        batch_puzzles[num_batch_puzzles++] = puzzles[i].puzzle;
+    }
+    for (u64 i = 0; i < num_wall_puzzles; i++) {
+        batch_puzzles[num_batch_puzzles++] = wall_puzzles[i].puzzle;
+    }
+    u64 scalar_solutions[16 * 2] = {0};
+    u64 lane_solutions[16 * 2] = {0};
+    SolveResult scalar_results[16];
+    SolveResult lane_results[16];
+    SolveBatch scalar_batch = {.puzzles = batch_puzzles,
+                               .num_puzzles = num_batch_puzzles,
+                               .solutions = scalar_solutions,
+                               .max_solutions = 2,
+                               .mode = SOLVE_ALL,
+                               .results = scalar_results};
+    SolveBatch lane_batch = scalar_batch;
+    lane_batch.solutions = lane_solutions;
+    lane_batch.results = lane_results;
+    solve_batch_scalar(&scalar_batch, 0, num_batch_puzzles);
+    solve_lanes(&lane_batch, 0, num_batch_puzzles);
+    bool lanes_match = memcmp(scalar_solutions, lane_solutions, sizeof(scalar_solutions)) == 0;
+    for (u64 i = 0; i < num_batch_puzzles; i++) {
+        lanes_match = lanes_match &&
+                      scalar_results[i].num_solutions == lane_results[i].num_solutions &&
+                      scalar_results[i].hit_max == lane_results[i].hit_max;
+    }
+    printf("Lane solver matches (%" PRIu64 " puzzles): %s\n", num_batch_puzzles,
+           lanes_match ? "yes" : "no (wrong)");
+
+    // Random puzzles, and the same puzzles without their first monster (which usually have no
+    // solutions or more than one), each at a different position on every bigger board. The
+    // bigger solvers are slow, so it's only a few.
+    GeneratedPuzzle size_puzzles[4];
+    u64 num_size_puzzles = generate_random(size_puzzles, 4, 2);
+    bool sizes_match = num_size_puzzles == 4;
+    for (i32 i = 0; i < (i32)num_size_puzzles; i++) {
+        Puzzle unique = size_puzzles[i].puzzle;
+        Puzzle changed = unique;
+        changed.monsters &= changed.monsters - 1;
+#define CHECK_BOARD_SIZE(N)                                                                        \
+        sizes_match = sizes_match && check_##N##x##N(unique, i % (N - 7), N - 8 - i % (N - 7)) &&  \
+                      check_##N##x##N(changed, i % (N - 7), N - 8 - i % (N - 7));
+        BOARD_SIZES(CHECK_BOARD_SIZE)
+#undef CHECK_BOARD_SIZE
+    }
+    printf("Bigger boards match solve (%" PRIu64 " puzzles): %s\n", num_size_puzzles,
+           sizes_match ? "yes" : "no (wrong)");
+
+    ScoredPuzzle scored_puzzles[8];
+    u64 num_scored_puzzles = generate_scored(scored_puzzles, 8, &score_range_all);
+    printf("\nScores (forced cells, branches, max depth):");
+    for (u64 i = 0; i < num_scored_puzzles; i++) {
+        PuzzleScore score = scored_puzzles[i].score;
+        printf(" (%u, %u, %u)", score.forced_cells, score.branches, score.max_depth);
+    }
+    ScoreRange harder = score_range_all;
+    harder.min.branches = 8;
+    u64 num_harder_puzzles = generate_scored_parallel(scored_puzzles, 8, &harder, 4);
+    printf("\nNum generated puzzles with 8+ branches (4 threads): %" PRIu64 "\n",
+           num_harder_puzzles);
+
+    GeneratedPuzzle random_puzzles[2];
+    u64 num_random_puzzles = generate_random(random_puzzles, 2, 1);
+    printf("\nRandom puzzles (seed 1): %" PRIu64 "\n", num_random_puzzles);
+    for (u64 i = 0; i < num_random_puzzles; i++) {
+        print_puzzle(random_puzzles[i].puzzle, random_puzzles[i].solution);
+        printf("\n");
+    }
+
+    // A puzzle the generator used to miss. The monster in the bottom row gets out through the cell
+    // above it, but it was rejected before the wall to its right was placed. Search the bottom row
+    // again from the rest of the puzzle and check that the puzzle comes up.
+    const char *missed = "T..XT..X"
+                         "...X...X"
+                         "...X...X"
+                         "XX.MXX.M"
+                         "MX.XMX.X"
+                         ".X.X.X.M"
+                         ".X.X...X"
+                         ".....XMX";
+    Tile missed_tiles[64];
+    for (i32 slot = 0; slot < 64; slot++) {
+        missed_tiles[slot] = (Tile)(strchr(".XMT", missed[slot]) - ".XMT");
+    }
+    GenState missed_state;
+    gen_init(&missed_state, missed_tiles, 56, 64);
+    missed_state.all_symmetries = true;
+    bool found_missed = false;
+    while (!found_missed && gen_next(&missed_state)) {
+        found_missed = memcmp(missed_state.puzzle_tiles, missed_tiles, sizeof(missed_tiles)) == 0;
+    }
+    printf("\nGenerates the puzzle with a late monster exit: %s\n",
+           found_missed ? "yes" : "no (wrong)");
+
+#if defined(DANDD_STATS)
+    printf("\n");
+    SolveStats solve_stats = {0};
+    solve_with_stats(p, solutions, 32, SOLVE_ALL, NULL, &solve_stats);
+    print_solve_stats("solve", &solve_stats);
+    GenerateStats generate_stats = {0};
+    generate_with_stats(puzzles, 8, NULL, &generate_stats);
+    print_solve_stats("generate (search)", &generate_stats.search);
+    print_solve_stats("generate (solves)", &generate_stats.solve);
+#endif
+    return found_missed && lanes_match && sizes_match ? 0 : 1;
 }
+
+#endif
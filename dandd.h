@@ -0,0 +1,136 @@
+// The dandd library, a solver and puzzle generator for Dungeons and Diagrams.
+// Build dandd.c with DANDD_LIBRARY defined (the cmake `dandd_static` and `dandd_shared` targets
+// do) to leave out main, the command line tools and everything that prints. Nothing in the library
+// keeps state between calls, the lookup tables are built once on first use (safely from any
+// thread) and never change after, so every function can be called from any number of threads.
+
+#ifndef DANDD_H
+#define DANDD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Only the functions declared here are exported from the library, everything else in dandd.c is
+// built hidden (the cmake targets set the visibility, and the static library's hidden symbols are
+// made local so they can't clash with the names in the program it's linked into).
+#if defined(_WIN32) && defined(DANDD_SHARED)
+#if defined(DANDD_LIBRARY)
+#define DANDD_API __declspec(dllexport)
+#else
+#define DANDD_API __declspec(dllimport)
+#endif
+#elif defined(__GNUC__) || defined(__clang__)
+#define DANDD_API __attribute__((visibility("default")))
+#else
+#define DANDD_API
+#endif
+
+// Boards are 8x8 matrices in row-major order, one bit per cell in a uint64_t with slot 0 (row 0,
+// column 0) in the top bit. In a solution a 1 is a wall.
+
+typedef struct {
+    int32_t row;
+    int32_t col;
+} Pos;
+
+// An easier to read and write representation of a puzzle.
+typedef struct {
+    uint8_t row_wall_counts[8];
+    uint8_t col_wall_counts[8];
+    Pos monsters[64];
+    uint8_t monsters_count;
+    Pos treasures[64];
+    uint8_t treasures_count;
+} PuzzleArgs;
+
+// The representation of a puzzle used internally. Monsters and treasures
+// are stored in a "solution" which makes comparing their positions to other solutions
+// via bitwise operations fast and easy.
+typedef struct {
+    uint8_t row_wall_counts[8];
+    uint8_t col_wall_counts[8];
+    uint64_t monsters;
+    uint64_t treasures;
+} Puzzle;
+
+typedef enum {
+    // Find every solution.
+    SOLVE_ALL,
+    // Stop at the first solution.
+    SOLVE_FIRST,
+    // Stop at the second solution. Enough to tell if a puzzle has 0, 1 or more than 1 solutions.
+    SOLVE_UNIQUE,
+} SolveMode;
+
+typedef struct {
+    // The number of solutions found. More than max_solutions (and not all recorded) if hit_max is
+    // set, at most 1 for SOLVE_FIRST and at most 2 for SOLVE_UNIQUE.
+    uint64_t num_solutions;
+    // Set if there were more solutions than fit in the solutions buffer.
+    bool hit_max;
+} SolveResult;
+
+typedef struct {
+    Puzzle puzzle;
+    // The board the puzzle was generated from, which is one of its solutions.
+    uint64_t solution;
+    // 0, 1, or 2 if the puzzle has more than 1 solution.
+    uint64_t num_solutions;
+} GeneratedPuzzle;
+
+// Called with each solution in order. Return false to stop the search.
+typedef bool (*SolutionFn)(void *userdata, uint64_t solution);
+
+// Called with each puzzle the generator finds. Return false to stop generating.
+typedef bool (*GeneratedPuzzleFn)(void *userdata, GeneratedPuzzle puzzle);
+
+// A block of memory from the caller that results are allocated from, so the size of a result set
+// is only limited by how much memory the caller hands over, and the library never allocates it.
+typedef struct {
+    uint8_t *memory;
+    uint64_t size;
+    uint64_t used;
+    // Set once an allocation didn't fit.
+    bool full;
+} Arena;
+
+DANDD_API Puzzle puzzle(PuzzleArgs args);
+
+// Solvers. They all find the same solutions in the same order, into a buffer of max_solutions.
+DANDD_API SolveResult solve(Puzzle puzzle, uint64_t *solutions, uint64_t max_solutions,
+                            SolveMode mode);
+DANDD_API SolveResult solve_parallel(Puzzle puzzle, uint64_t *solutions, uint64_t max_solutions,
+                                     SolveMode mode, int32_t num_threads);
+DANDD_API SolveResult solve_rows(Puzzle puzzle, uint64_t *solutions, uint64_t max_solutions,
+                                 SolveMode mode);
+DANDD_API SolveResult solve_propagate(Puzzle puzzle, uint64_t *solutions, uint64_t max_solutions,
+                                      SolveMode mode);
+DANDD_API void solve_batch(const Puzzle *puzzles, uint64_t num_puzzles, uint64_t *solutions,
+                           uint64_t max_solutions, SolveMode mode, SolveResult *results,
+                           int32_t num_threads);
+DANDD_API uint64_t solve_each(Puzzle puzzle, SolutionFn on_solution, void *userdata);
+DANDD_API uint64_t count_solutions(Puzzle puzzle);
+
+DANDD_API bool validate_solution(const Puzzle *puzzle, uint64_t solution);
+DANDD_API uint64_t validate_solution_cells(const Puzzle *puzzle, uint64_t solution);
+
+// Generators, into a buffer of max_puzzles or calling a function with each puzzle.
+DANDD_API uint64_t generate(GeneratedPuzzle *puzzles, uint64_t max_puzzles);
+DANDD_API uint64_t generate_parallel(GeneratedPuzzle *puzzles, uint64_t max_puzzles,
+                                     int32_t num_threads);
+DANDD_API uint64_t generate_walls(GeneratedPuzzle *puzzles, uint64_t max_puzzles);
+DANDD_API uint64_t generate_random(GeneratedPuzzle *puzzles, uint64_t max_puzzles, uint64_t seed);
+DANDD_API uint64_t generate_each(GeneratedPuzzleFn on_puzzle, void *userdata);
+DANDD_API uint64_t generate_parallel_each(GeneratedPuzzleFn on_puzzle, void *userdata,
+                                          int32_t num_threads);
+DANDD_API uint64_t generate_walls_each(GeneratedPuzzleFn on_puzzle, void *userdata);
+
+// Arenas, and solving and generating into them.
+DANDD_API Arena arena_init(void *memory, uint64_t size);
+DANDD_API void *arena_alloc(Arena *arena, uint64_t size);
+DANDD_API void arena_reset(Arena *arena);
+DANDD_API SolveResult solve_arena(Puzzle puzzle, SolveMode mode, Arena *arena,
+                                  uint64_t **solutions);
+DANDD_API uint64_t generate_arena(uint64_t max_puzzles, Arena *arena, GeneratedPuzzle **puzzles);
+
+#endif